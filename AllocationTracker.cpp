@@ -0,0 +1,99 @@
+#include "AllocationTracker.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+#include <sys/resource.h>
+
+namespace {
+    std::atomic<bool> tracking(false);
+    std::atomic<uint64_t> allocationCount(0);
+    std::atomic<uint64_t> allocatedBytes(0);
+    std::atomic<int64_t> liveBytes(0); // usable sizes, so that frees balance allocations exactly
+    std::atomic<int64_t> peakLiveBytes(0);
+
+    void raisePeak(int64_t live) {
+        int64_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+        while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    }
+
+    long peakRssKilobytes() {
+        struct rusage usage;
+        return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+    }
+}
+
+void* operator new(std::size_t size) {
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+    if (tracking.load(std::memory_order_relaxed)) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+        int64_t usable = malloc_usable_size(memory);
+        raisePeak(liveBytes.fetch_add(usable, std::memory_order_relaxed) + usable);
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    if (memory && tracking.load(std::memory_order_relaxed)) {
+        liveBytes.fetch_sub(malloc_usable_size(memory), std::memory_order_relaxed);
+    }
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    operator delete(memory);
+}
+
+int AllocationTracker::depth = 0;
+
+std::vector<AllocationTracker::PhaseCounts>& AllocationTracker::phases() {
+    static std::vector<PhaseCounts> list;
+    return list;
+}
+
+void AllocationTracker::enable() {
+    phases().reserve(256); // keep the list's own growth out of most phases
+    tracking = true;
+}
+
+bool AllocationTracker::enabled() {
+    return tracking;
+}
+
+AllocationTracker::Phase::Phase(const std::string& name) : record(-1) {
+    if (!tracking) return;
+    record = phases().size();
+    phases().push_back({name, depth++, 0, 0, 0, 0});
+    startAllocations = allocationCount;
+    startBytes = allocatedBytes;
+    startLiveBytes = liveBytes;
+    outerPeak = peakLiveBytes.exchange(startLiveBytes);
+}
+
+AllocationTracker::Phase::~Phase() {
+    if (record == static_cast<size_t>(-1)) return;
+    PhaseCounts& counts = phases()[record];
+    counts.allocations = allocationCount - startAllocations;
+    counts.bytes = allocatedBytes - startBytes;
+    counts.peakHeapBytes = peakLiveBytes - startLiveBytes;
+    counts.peakRssKilobytes = peakRssKilobytes();
+    raisePeak(outerPeak);
+    depth--;
+}
+
+// One row per phase in the order they began, nested phases indented under their parent.
+void AllocationTracker::report(std::ostream& output) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-32s %12s %14s %14s %12s\n", "phase", "allocations", "bytes", "peak heap", "peak RSS KB");
+    output << line;
+    for (const PhaseCounts& counts : phases()) {
+        std::string name = std::string(2 * counts.depth, ' ') + counts.name;
+        std::snprintf(line, sizeof(line), "%-32s %12llu %14llu %14lld %12ld\n", name.c_str(),
+            static_cast<unsigned long long>(counts.allocations), static_cast<unsigned long long>(counts.bytes),
+            static_cast<long long>(counts.peakHeapBytes), counts.peakRssKilobytes);
+        output << line;
+    }
+}
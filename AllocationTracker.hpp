@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Counts heap allocations for --alloc-report. The global operator new and delete are replaced
+// in AllocationTracker.cpp; they only count once enable() was called, so normal builds pay a
+// single relaxed load per allocation.
+//
+// Work is split into named phases, which may nest. For each phase the report gives the
+// allocations made and bytes requested on every thread while it ran, the peak growth of live
+// heap bytes over its start, and the peak resident set size of the process at its end.
+class AllocationTracker {
+public:
+    // Measures the enclosing scope as one phase.
+    class Phase {
+    public:
+        Phase(const std::string& name);
+        ~Phase();
+        Phase(const Phase&) = delete;
+        Phase& operator=(const Phase&) = delete;
+    private:
+        size_t record;             // in the phase list, -1 when not tracking
+        uint64_t startAllocations; // counters when the phase began
+        uint64_t startBytes;
+        int64_t startLiveBytes;
+        int64_t outerPeak;         // peak of the enclosing phase so far
+    };
+
+    static void enable();
+    static bool enabled();
+    static void report(std::ostream& output);
+private:
+    struct PhaseCounts {
+        std::string name;
+        int depth;
+        uint64_t allocations;
+        uint64_t bytes;
+        int64_t peakHeapBytes;
+        long peakRssKilobytes;
+    };
+
+    static std::vector<PhaseCounts>& phases();
+    static int depth;
+};
@@ -0,0 +1,252 @@
+#include "BatchedIO.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    const unsigned ringEntries = 64;
+
+    int enterRing(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+    }
+}
+
+BatchedIO::BatchedIO() : ringFd(-1), submissionRing(MAP_FAILED), submissionRingSize(0), completionRing(MAP_FAILED), completionRingSize(0),
+    submissionEntries(MAP_FAILED), submissionEntriesSize(0), entries(0), unsubmitted(0), inFlight(0) {
+    if (!setUpRing()) {
+        closeRing();
+    }
+}
+
+BatchedIO::~BatchedIO() {
+    // the kernel may still be writing into the buffers
+    try {
+        submit();
+        while (inFlight > 0) reap(true);
+    }
+    catch (const std::runtime_error&) {}
+    for (Request& request : requests) {
+        if (request.fd >= 0) close(request.fd);
+    }
+    closeRing();
+}
+
+bool BatchedIO::usesRing() const {
+    return ringFd >= 0;
+}
+
+// Creates the ring and maps its submission and completion queues. Fails when the kernel is
+// too old or io_uring is disabled, as it often is in containers.
+bool BatchedIO::setUpRing() {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ringFd = syscall(__NR_io_uring_setup, ringEntries, &params);
+    if (ringFd < 0) return false;
+    entries = params.sq_entries;
+
+    submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMapping) {
+        submissionRingSize = completionRingSize = std::max(submissionRingSize, completionRingSize);
+    }
+    submissionRing = mmap(nullptr, submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (submissionRing == MAP_FAILED) return false;
+    if (singleMapping) {
+        completionRing = submissionRing;
+    }
+    else {
+        completionRing = mmap(nullptr, completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (completionRing == MAP_FAILED) return false;
+    }
+    submissionEntriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    submissionEntries = mmap(nullptr, submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (submissionEntries == MAP_FAILED) return false;
+
+    char* submission = static_cast<char*>(submissionRing);
+    submissionTail = reinterpret_cast<unsigned*>(submission + params.sq_off.tail);
+    submissionMask = reinterpret_cast<unsigned*>(submission + params.sq_off.ring_mask);
+    submissionArray = reinterpret_cast<unsigned*>(submission + params.sq_off.array);
+    char* completion = static_cast<char*>(completionRing);
+    completionHead = reinterpret_cast<unsigned*>(completion + params.cq_off.head);
+    completionTail = reinterpret_cast<unsigned*>(completion + params.cq_off.tail);
+    completionMask = reinterpret_cast<unsigned*>(completion + params.cq_off.ring_mask);
+    completionEntries = completion + params.cq_off.cqes;
+    return true;
+}
+
+void BatchedIO::closeRing() {
+    if (submissionEntries != MAP_FAILED) munmap(submissionEntries, submissionEntriesSize);
+    if (completionRing != MAP_FAILED && completionRing != submissionRing) munmap(completionRing, completionRingSize);
+    if (submissionRing != MAP_FAILED) munmap(submissionRing, submissionRingSize);
+    submissionEntries = completionRing = submissionRing = MAP_FAILED;
+    if (ringFd >= 0) close(ringFd);
+    ringFd = -1;
+}
+
+size_t BatchedIO::submitRead(const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0) {
+        if (fd >= 0) close(fd);
+        throw std::runtime_error("BatchedIO: unable to open " + path.string() + " for reading.");
+    }
+    requests.push_back({path, false, fd, std::string(status.st_size, '\0'), {}, false, 0});
+    size_t request = requests.size() - 1;
+    if (usesRing() && status.st_size > 0) {
+        queue(request);
+    }
+    else {
+        complete(request, 0);
+    }
+    return request;
+}
+
+// Returns the contents of a file passed to submitRead(). Also passes any queued requests to
+// the kernel, so writes submitted since the last call start while the caller compiles.
+std::string BatchedIO::awaitRead(size_t request) {
+    submit();
+    reap(false);
+    while (!requests[request].done) {
+        reap(true);
+    }
+    Request& read = requests[request];
+    if (read.error) {
+        throw std::runtime_error("BatchedIO: unable to read " + read.path.string() + ": " + std::strerror(read.error) + ".");
+    }
+    return std::move(read.data);
+}
+
+void BatchedIO::submitWrite(const std::filesystem::path& path, std::string contents) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("BatchedIO: unable to open " + path.string() + " for writing.");
+    }
+    requests.push_back({path, true, fd, std::move(contents), {}, false, 0});
+    size_t request = requests.size() - 1;
+    if (usesRing() && !requests[request].data.empty()) {
+        queue(request);
+    }
+    else {
+        complete(request, 0);
+    }
+}
+
+// Waits for every write and reports the first that failed.
+void BatchedIO::finish() {
+    submit();
+    while (inFlight > 0) {
+        reap(true);
+    }
+    for (const Request& request : requests) {
+        if (request.isWrite && request.error) {
+            throw std::runtime_error("BatchedIO: unable to write " + request.path.string() + ": " + std::strerror(request.error) + ".");
+        }
+    }
+}
+
+// Adds a vectored read or write of the whole file to the submission queue, first making room
+// when every entry is taken.
+void BatchedIO::queue(size_t request) {
+    while (unsubmitted + inFlight >= entries) {
+        submit();
+        reap(true);
+    }
+    Request& transfer = requests[request];
+    transfer.buffer.iov_base = &transfer.data[0];
+    transfer.buffer.iov_len = transfer.data.size();
+
+    unsigned tail = *submissionTail; // only this side moves the tail
+    unsigned index = tail & *submissionMask;
+    struct io_uring_sqe* entry = static_cast<struct io_uring_sqe*>(submissionEntries) + index;
+    std::memset(entry, 0, sizeof(*entry));
+    entry->opcode = transfer.isWrite ? IORING_OP_WRITEV : IORING_OP_READV;
+    entry->fd = transfer.fd;
+    entry->addr = reinterpret_cast<uint64_t>(&transfer.buffer);
+    entry->len = 1;
+    entry->off = 0;
+    entry->user_data = request;
+    submissionArray[index] = index;
+    __atomic_store_n(submissionTail, tail + 1, __ATOMIC_RELEASE);
+    unsubmitted++;
+}
+
+void BatchedIO::submit() {
+    while (unsubmitted > 0) {
+        int submitted = enterRing(ringFd, unsubmitted, 0, 0);
+        if (submitted < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("BatchedIO: io_uring_enter failed: ") + std::strerror(errno) + ".");
+        }
+        unsubmitted -= submitted;
+        inFlight += submitted;
+    }
+}
+
+// Handles the completions posted so far, first waiting for one if `wait` is set.
+void BatchedIO::reap(bool wait) {
+    if (!usesRing() || inFlight == 0) return;
+    if (wait) {
+        while (enterRing(ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0) {
+            if (errno != EINTR) {
+                throw std::runtime_error(std::string("BatchedIO: io_uring_enter failed: ") + std::strerror(errno) + ".");
+            }
+        }
+    }
+    unsigned head = *completionHead;
+    unsigned tail = __atomic_load_n(completionTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        const struct io_uring_cqe& completion = static_cast<struct io_uring_cqe*>(completionEntries)[head & *completionMask];
+        size_t request = completion.user_data;
+        int result = completion.res;
+        head++;
+        __atomic_store_n(completionHead, head, __ATOMIC_RELEASE);
+        inFlight--;
+        complete(request, result);
+    }
+}
+
+// Finishes a request of which `result` bytes were transferred, or that failed with -result.
+// Short transfers and requests made without a ring are completed with pread/pwrite.
+void BatchedIO::complete(size_t request, int result) {
+    Request& transfer = requests[request];
+    if (result < 0) {
+        transfer.error = -result;
+    }
+    else if (static_cast<size_t>(result) < transfer.data.size()) {
+        transfer.error = transferRest(transfer, result);
+    }
+    close(transfer.fd);
+    transfer.fd = -1;
+    transfer.done = true;
+    if (transfer.isWrite) {
+        std::string().swap(transfer.data);
+    }
+}
+
+// Returns 0 or the errno of the failed call.
+int BatchedIO::transferRest(Request& request, size_t done) {
+    while (done < request.data.size()) {
+        ssize_t count = request.isWrite
+            ? pwrite(request.fd, request.data.data() + done, request.data.size() - done, done)
+            : pread(request.fd, &request.data[done], request.data.size() - done, done);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        if (count == 0) {
+            if (request.isWrite) return EIO;
+            request.data.resize(done); // the file shrank since it was opened
+            break;
+        }
+        done += count;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <sys/uio.h>
+
+// Reads the sources and writes the outputs of a build as batches, so that the build waits on
+// the file system once per batch rather than once per file. Requests go through io_uring when
+// the kernel allows it; otherwise each one is done with pread/pwrite when it is submitted.
+//
+// Reads are submitted up front and awaited one at a time, so later files arrive while earlier
+// ones are compiled. Writes are queued as outputs become ready and awaited by finish().
+class BatchedIO {
+public:
+    BatchedIO();
+    ~BatchedIO();
+    BatchedIO(const BatchedIO&) = delete;
+    BatchedIO& operator=(const BatchedIO&) = delete;
+
+    size_t submitRead(const std::filesystem::path& path);
+    std::string awaitRead(size_t request);
+    void submitWrite(const std::filesystem::path& path, std::string contents);
+    void finish();
+    bool usesRing() const;
+private:
+    struct Request {
+        std::filesystem::path path;
+        bool isWrite;
+        int fd;
+        std::string data; // read into, or written from
+        struct iovec buffer;
+        bool done;
+        int error; // errno of a failed request
+    };
+
+    bool setUpRing();
+    void closeRing();
+    void queue(size_t request);
+    void submit();
+    void reap(bool wait);
+    void complete(size_t request, int result);
+    int transferRest(Request& request, size_t done);
+
+    std::deque<Request> requests; // stable addresses: the kernel holds pointers to the iovecs
+    int ringFd;
+    void* submissionRing;
+    size_t submissionRingSize;
+    void* completionRing;
+    size_t completionRingSize;
+    void* submissionEntries;
+    size_t submissionEntriesSize;
+    unsigned* submissionTail;
+    unsigned* submissionMask;
+    unsigned* submissionArray;
+    unsigned* completionHead;
+    unsigned* completionTail;
+    unsigned* completionMask;
+    void* completionEntries;
+    unsigned entries;
+    unsigned unsubmitted; // queued but not yet passed to the kernel
+    unsigned inFlight;    // passed to the kernel and not yet completed
+};
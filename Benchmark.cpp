@@ -0,0 +1,634 @@
+#include "Benchmark.hpp"
+#include "JackAnalyzer.hpp"
+#include "KeyWords.hpp"
+#include "CompilationEngine.hpp"
+#include "SymbolTable.hpp"
+#include "VMWriter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+    // xorshift32, so that the generated code is the same with every standard library.
+    class Random {
+    public:
+        Random(uint32_t seed) : state(seed) {}
+        uint32_t next() {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        }
+        int below(int n) {
+            return next() % n;
+        }
+    private:
+        uint32_t state;
+    };
+
+    // How the generated code of a corpus leans.
+    struct Style {
+        int nClasses;
+        int nSubroutines;  // per class
+        int nStatements;   // top-level statements per subroutine
+        int nTerms;        // per expression
+        int nCommentLines; // before every statement
+        int stringPercent; // share of statements that build and print a string constant
+    };
+
+    // Writes classes of synthetic but typical Jack: fields, a constructor, methods and
+    // functions with branches, loops and array accesses, calling earlier functions of the
+    // class and the first function of the previous class.
+    class ClassWriter {
+    public:
+        ClassWriter(Random& random, const Style& style) : random(random), style(style), depth(0) {}
+
+        std::string write(const std::string& name, const std::string& previous) {
+            className = name;
+            previousClass = previous;
+            out.str("");
+            out << "/** Generated by the --benchmark corpus generator. */\n";
+            out << "class " << name << " {\n";
+            out << "    field int x, y;\n";
+            out << "    field Array data;\n";
+            out << "    static int count;\n\n";
+            out << "    constructor " << name << " new(int ax, int ay) {\n";
+            out << "        let x = ax;\n";
+            out << "        let y = ay;\n";
+            out << "        let data = Array.new(16);\n";
+            out << "        let count = count + 1;\n";
+            out << "        return this;\n";
+            out << "    }\n";
+            for (nFunctions = 0; nFunctions < style.nSubroutines; nFunctions++) {
+                isMethod = nFunctions % 4 == 3;
+                out << "\n";
+                comment("    ");
+                if (isMethod) {
+                    out << "    method int m" << nFunctions << "(int a, int b) {\n";
+                }
+                else {
+                    out << "    function int s" << nFunctions << "(int a, int b) {\n";
+                }
+                out << "        var int i, j, k, n;\n";
+                out << "        var Array t;\n";
+                out << "        var String s;\n";
+                out << "        let n = a + b;\n";
+                out << "        let t = Array.new(16);\n";
+                for (int i = 0; i < style.nStatements; i++) {
+                    statement(2);
+                }
+                out << "        do t.dispose();\n";
+                out << "        return " << expression() << ";\n";
+                out << "    }\n";
+            }
+            out << "}\n";
+            return out.str();
+        }
+    private:
+        std::string variable() {
+            static const char* locals[] = {"a", "b", "i", "j", "k", "n"};
+            static const char* fields[] = {"x", "y", "count"};
+            if (isMethod && random.below(4) == 0) return fields[random.below(3)];
+            return locals[random.below(6)];
+        }
+
+        std::string call() {
+            int callee = random.below(nFunctions + 1);
+            if (callee < nFunctions && callee % 4 != 3) {
+                return className + ".s" + std::to_string(callee) + "(" + variable() + ", " + term() + ")";
+            }
+            if (!previousClass.empty()) {
+                return previousClass + ".s0(" + variable() + ", " + std::to_string(random.below(100)) + ")";
+            }
+            return "Math.max(" + variable() + ", " + variable() + ")";
+        }
+
+        std::string term() {
+            switch (random.below(depth < 3 ? 10 : 6)) {
+                case 0: case 1: case 2: return std::to_string(random.below(1000));
+                case 3: case 4: return variable();
+                case 5: return "t[" + variable() + "]";
+                case 6: return "-" + variable();
+                case 7: return "(" + variable() + " + " + std::to_string(random.below(10)) + ")";
+                case 8: return call();
+                default: {
+                    depth++;
+                    std::string nested = "(" + expression(2 + random.below(4)) + ")";
+                    depth--;
+                    return nested;
+                }
+            }
+        }
+
+        std::string expression(int nTerms = 0) {
+            static const char* ops[] = {"+", "-", "+", "*", "&", "|", "+", "-", "/"};
+            if (nTerms == 0) nTerms = 1 + random.below(style.nTerms);
+            std::string text = term();
+            for (int i = 1; i < nTerms; i++) {
+                text += std::string(" ") + ops[random.below(9)] + " " + term();
+            }
+            return text;
+        }
+
+        void comment(const std::string& indent) {
+            for (int i = 0; i < style.nCommentLines; i++) {
+                switch (random.below(3)) {
+                    case 0: out << indent << "// keeps " << variable() << " within range for the next step\n"; break;
+                    case 1: out << indent << "/* the value of " << variable() << " is reused below */\n"; break;
+                    default: out << indent << "/** Updates the running total.\n" << indent << "  * Assumes " << variable() << " > 0. */\n"; break;
+                }
+            }
+        }
+
+        void statement(int level) {
+            std::string indent(4 * level, ' ');
+            comment(indent);
+            if (random.below(100) < style.stringPercent) {
+                out << indent << "let s = \"Synthetic string constant number " << random.below(100000) << " of the corpus\";\n";
+                out << indent << "do Output.printString(s);\n";
+                out << indent << "do s.dispose();\n";
+                return;
+            }
+            int kind = random.below(level < 4 ? 8 : 5);
+            switch (kind) {
+                case 0: case 1:
+                    out << indent << "let " << variable() << " = " << expression() << ";\n";
+                    break;
+                case 2:
+                    out << indent << "let t[" << variable() << " & 15] = " << expression() << ";\n";
+                    break;
+                case 3:
+                    out << indent << "do Output.printInt(" << expression() << ");\n";
+                    break;
+                case 4:
+                    if (isMethod) {
+                        out << indent << "let data[x & 15] = " << expression() << ";\n";
+                    }
+                    else {
+                        out << indent << "let k = " << call() << ";\n";
+                    }
+                    break;
+                case 5: case 6:
+                    out << indent << "if (" << expression() << " < " << expression() << ") {\n";
+                    for (int i = 0; i < 2; i++) statement(level + 1);
+                    out << indent << "}\n" << indent << "else {\n";
+                    statement(level + 1);
+                    out << indent << "}\n";
+                    break;
+                default:
+                    out << indent << "let i = 0;\n";
+                    out << indent << "while (i < n) {\n";
+                    for (int i = 0; i < 2; i++) statement(level + 1);
+                    out << indent << "    let i = i + 1;\n";
+                    out << indent << "}\n";
+                    break;
+            }
+        }
+
+        Random& random;
+        const Style& style;
+        std::ostringstream out;
+        std::string className;
+        std::string previousClass;
+        int nFunctions; // subroutines written so far
+        bool isMethod;
+        int depth;      // of nested parenthesized expressions
+    };
+
+    long countLines(const std::string& text) {
+        return std::count(text.begin(), text.end(), '\n');
+    }
+
+    // A class of functions that each compute one expression of `nTerms` terms. When `nested`,
+    // every term encloses the rest of the expression in parentheses, an array index, an argument
+    // list or a unary operator, so the expression is as deep as it is long; otherwise the terms
+    // form one flat chain of binary operators. Lines break every few terms, as people write them.
+    std::string expressionClass(const std::string& name, int nFunctions, int nTerms, bool nested) {
+        static const char* ops[] = {"+", "-", "&", "|", "*", "/"};
+        std::string text = "/** Generated by the --benchmark corpus generator. */\n";
+        text += "class " + name + " {\n";
+        for (int f = 0; f < nFunctions; f++) {
+            text += "    function int f" + std::to_string(f) + "(int a, int b) {\n";
+            text += "        var Array t;\n";
+            text += "        let t = Array.new(16);\n";
+            text += "        let a = ";
+            std::vector<std::string> closing;
+            for (int i = 0; i < nTerms; i++) {
+                if (i > 0 && i % 8 == 0) {
+                    if (text.back() == ' ') text.pop_back();
+                    text += "\n            ";
+                }
+                std::string term = i % 3 == 0 ? "a" : i % 3 == 1 ? "b" : std::to_string(i % 100);
+                if (!nested) {
+                    text += (i > 0 ? std::string(" ") + ops[(i + f) % 6] + " " : "") + term;
+                    continue;
+                }
+                switch ((i + f) % 4) {
+                    case 0: text += term + " + ("; closing.push_back(")"); break;
+                    case 1: text += "t[(" + term + " + "; closing.push_back(") & 15]"); break;
+                    case 2: text += "Math.max(" + term + ", "; closing.push_back(")"); break;
+                    default: text += "-(" + term + " - "; closing.push_back(")"); break;
+                }
+            }
+            if (nested) {
+                text += "b";
+                for (auto c = closing.rbegin(); c != closing.rend(); ++c) text += *c;
+            }
+            text += ";\n";
+            text += "        do t.dispose();\n";
+            text += "        return a;\n";
+            text += "    }\n";
+        }
+        text += "}\n";
+        return text;
+    }
+
+    // Runnable programs that allocate and dispose many small objects. Each prints a checksum;
+    // copies with an expected output are in tests/alloc_linked_list and tests/alloc_particles.
+    std::vector<std::pair<std::string, std::string>> linkedListProgram(int scale) {
+        return {
+            {"Node",
+                "/** Generated by the --benchmark corpus generator. */\n"
+                "class Node {\n"
+                "    field int value;\n"
+                "    field Node next;\n\n"
+                "    constructor Node new(int v, Node n) {\n"
+                "        let value = v;\n"
+                "        let next = n;\n"
+                "        return this;\n"
+                "    }\n"
+                "    method int getValue() { return value; }\n"
+                "    method Node getNext() { return next; }\n"
+                "    method void dispose() {\n"
+                "        do Memory.deAlloc(this);\n"
+                "        return;\n"
+                "    }\n"
+                "}\n"},
+            {"Main",
+                "/** Generated by the --benchmark corpus generator. Builds, sums and frees lists. */\n"
+                "class Main {\n"
+                "    function void main() {\n"
+                "        var Node head, node, next;\n"
+                "        var int round, i, sum;\n"
+                "        let sum = 0;\n"
+                "        let round = 0;\n"
+                "        while (round < " + std::to_string(20 * scale) + ") {\n"
+                "            let head = null;\n"
+                "            let i = 0;\n"
+                "            while (i < 300) {\n"
+                "                let head = Node.new(i + round, head);\n"
+                "                let i = i + 1;\n"
+                "            }\n"
+                "            let node = head;\n"
+                "            while (~(node = null)) {\n"
+                "                let sum = (sum + node.getValue()) & 4095;\n"
+                "                let next = node.getNext();\n"
+                "                do node.dispose();\n"
+                "                let node = next;\n"
+                "            }\n"
+                "            let round = round + 1;\n"
+                "        }\n"
+                "        do Output.printInt(sum);\n"
+                "        return;\n"
+                "    }\n"
+                "}\n"},
+        };
+    }
+
+    std::vector<std::pair<std::string, std::string>> particleProgram(int scale) {
+        return {
+            {"Vec",
+                "/** Generated by the --benchmark corpus generator. */\n"
+                "class Vec {\n"
+                "    field int x, y;\n\n"
+                "    constructor Vec new(int ax, int ay) {\n"
+                "        let x = ax;\n"
+                "        let y = ay;\n"
+                "        return this;\n"
+                "    }\n"
+                "    method int getX() { return x; }\n"
+                "    method int getY() { return y; }\n"
+                "    method void dispose() {\n"
+                "        do Memory.deAlloc(this);\n"
+                "        return;\n"
+                "    }\n"
+                "}\n"},
+            {"Particle",
+                "/** Generated by the --benchmark corpus generator. Replaces its velocity every step. */\n"
+                "class Particle {\n"
+                "    field int x, y, life;\n"
+                "    field Vec velocity;\n\n"
+                "    constructor Particle new(int seed) {\n"
+                "        let x = seed & 127;\n"
+                "        let y = (seed * 7) & 127;\n"
+                "        let life = 5 + (seed & 15);\n"
+                "        let velocity = Vec.new((seed & 7) - 3, ((seed / 8) & 7) - 3);\n"
+                "        return this;\n"
+                "    }\n"
+                "    method boolean step() {\n"
+                "        var Vec v;\n"
+                "        let v = Vec.new(velocity.getX(), velocity.getY() + 1);\n"
+                "        do velocity.dispose();\n"
+                "        let velocity = v;\n"
+                "        let x = x + v.getX();\n"
+                "        let y = y + v.getY();\n"
+                "        let life = life - 1;\n"
+                "        return life > 0;\n"
+                "    }\n"
+                "    method int checksum() { return x + y; }\n"
+                "    method void dispose() {\n"
+                "        do velocity.dispose();\n"
+                "        do Memory.deAlloc(this);\n"
+                "        return;\n"
+                "    }\n"
+                "}\n"},
+            {"Main",
+                "/** Generated by the --benchmark corpus generator. Steps a pool of particles, replacing dead ones. */\n"
+                "class Main {\n"
+                "    function void main() {\n"
+                "        var Array particles;\n"
+                "        var Particle p;\n"
+                "        var int i, t, seed, sum;\n"
+                "        let particles = Array.new(64);\n"
+                "        let seed = 1;\n"
+                "        let i = 0;\n"
+                "        while (i < 64) {\n"
+                "            let particles[i] = Particle.new(seed);\n"
+                "            let seed = ((seed * 13) + 7) & 1023;\n"
+                "            let i = i + 1;\n"
+                "        }\n"
+                "        let t = 0;\n"
+                "        while (t < " + std::to_string(40 * scale) + ") {\n"
+                "            let i = 0;\n"
+                "            while (i < 64) {\n"
+                "                let p = particles[i];\n"
+                "                if (~p.step()) {\n"
+                "                    let sum = (sum + p.checksum()) & 8191;\n"
+                "                    do p.dispose();\n"
+                "                    let particles[i] = Particle.new(seed);\n"
+                "                    let seed = ((seed * 13) + 7) & 1023;\n"
+                "                }\n"
+                "                let i = i + 1;\n"
+                "            }\n"
+                "            let t = t + 1;\n"
+                "        }\n"
+                "        do Output.printInt(sum);\n"
+                "        return;\n"
+                "    }\n"
+                "}\n"},
+        };
+    }
+}
+
+Benchmark::Benchmark(std::filesystem::path workDir, int scale, CompilerOptions options) : workDir(workDir), scale(std::max(1, scale)), options(options) {}
+
+void Benchmark::run(std::ostream& output) {
+    generate();
+    output << "# jack benchmark 1, scale " << scale << ", jobs " << options.jobs << "\n";
+    for (const Corpus& corpus : corpora) {
+        output << "# corpus " << corpus.name << ": " << corpus.files.size() << " files, " << corpus.lines << " lines, " << corpus.bytes << " bytes\n";
+    }
+    for (const Corpus& corpus : corpora) {
+        benchmarkLexer(output, corpus);
+    }
+    for (const Corpus& corpus : corpora) {
+        benchmarkCompiler(output, corpus);
+    }
+    benchmarkKeyWords(output);
+    benchmarkSymbolTable(output);
+    benchmarkVMWriter(output);
+    for (const Corpus& corpus : corpora) {
+        benchmarkDirectory(output, corpus);
+    }
+}
+
+// Writes one project per style, and the allocation workloads, under the work directory,
+// replacing earlier runs.
+void Benchmark::generate() {
+    const std::vector<std::pair<std::string, Style>> styles = {
+        {"many-classes",     {60 * scale, 8, 8, 6, 0, 0}},
+        {"huge-class",       {1, 400 * scale, 8, 6, 0, 0}},
+        {"long-expressions", {4 * scale, 10, 4, 120, 0, 0}},
+        {"comment-heavy",    {20 * scale, 8, 8, 6, 4, 0}},
+        {"string-heavy",     {20 * scale, 8, 8, 6, 0, 40}},
+    };
+    Random random(20240601);
+    for (const auto& style : styles) {
+        Corpus& corpus = addCorpus(style.first);
+        ClassWriter writer(random, style.second);
+        for (int i = 0; i < style.second.nClasses; i++) {
+            std::string name = "C" + std::to_string(i);
+            addSource(corpus, name, writer.write(name, i > 0 ? "C" + std::to_string(i - 1) : ""));
+        }
+    }
+    for (bool nested : {true, false}) {
+        Corpus& corpus = addCorpus(nested ? "deep-nesting" : "wide-chains");
+        for (int i = 0; i < 2 * scale; i++) {
+            std::string name = (nested ? "D" : "W") + std::to_string(i);
+            addSource(corpus, name, expressionClass(name, 8, nested ? 1000 : 4000, nested));
+        }
+    }
+    const std::vector<std::pair<std::string, std::vector<std::pair<std::string, std::string>>>> programs = {
+        {"alloc-linked-list", linkedListProgram(scale)},
+        {"alloc-particles",   particleProgram(scale)},
+    };
+    for (const auto& program : programs) {
+        Corpus& corpus = addCorpus(program.first);
+        for (const auto& source : program.second) {
+            addSource(corpus, source.first, source.second);
+        }
+    }
+}
+
+Benchmark::Corpus& Benchmark::addCorpus(const std::string& name) {
+    Corpus corpus{name, workDir / name, {}, {}, 0, 0};
+    std::filesystem::remove_all(corpus.dir);
+    std::filesystem::create_directories(corpus.dir);
+    corpora.push_back(std::move(corpus));
+    return corpora.back();
+}
+
+void Benchmark::addSource(Corpus& corpus, const std::string& className, std::string source) {
+    std::filesystem::path file = corpus.dir / (className + ".jack");
+    std::ofstream out(file);
+    if (!out) {
+        throw std::runtime_error("Benchmark: unable to write " + file.string() + ".");
+    }
+    out << source;
+    corpus.files.push_back(file);
+    corpus.lines += countLines(source);
+    corpus.bytes += source.size();
+    corpus.sources.push_back(std::move(source));
+}
+
+// Runs `operation` at least three times and for at least half a second, then prints the
+// fastest run. `items` is what one run processes, reported as a rate in `unit`s per second.
+void Benchmark::measure(std::ostream& output, const std::string& name, double items, const std::string& unit, const std::function<void()>& operation) {
+    using Clock = std::chrono::steady_clock;
+    double best = 0;
+    int iterations = 0;
+    Clock::time_point start = Clock::now();
+    while (iterations < 3 || Clock::now() - start < std::chrono::milliseconds(500)) {
+        Clock::time_point before = Clock::now();
+        operation();
+        double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - before).count();
+        if (iterations == 0 || nanoseconds < best) best = nanoseconds;
+        iterations++;
+    }
+    char line[256];
+    std::snprintf(line, sizeof(line), "%s\t%d\t%.0f ns/op\t%.0f %s/s\n", name.c_str(), iterations, best, items / (best / 1e9), unit.c_str());
+    output << line << std::flush;
+}
+
+// Tokenizes every source of the corpus from memory.
+void Benchmark::benchmarkLexer(std::ostream& output, const Corpus& corpus) {
+    measure(output, "lex/" + corpus.name, corpus.lines, "lines", [&corpus]() {
+        for (const std::string& source : corpus.sources) {
+            JackTokenizer tokenizer(source, 0, 1);
+            while (tokenizer.hasMoreTokens()) {
+                tokenizer.advance();
+                tokenizer.tokenType();
+            }
+        }
+    });
+}
+
+// Parses and generates code for every class of the corpus into memory.
+void Benchmark::benchmarkCompiler(std::ostream& output, const Corpus& corpus) {
+    ClassIndex classIndex(corpus.dir, [&corpus](const std::filesystem::path& file) -> const std::string& {
+        size_t i = std::find(corpus.files.begin(), corpus.files.end(), file) - corpus.files.begin();
+        return corpus.sources.at(i);
+    });
+    Profiler profiler(corpus.dir);
+    measure(output, "compile/" + corpus.name, corpus.lines, "lines", [&]() {
+        for (const std::filesystem::path& file : corpus.files) {
+            CompilationEngine engine(file, classIndex, profiler, options);
+            engine.compileClass();
+        }
+    });
+}
+
+// Builds the whole corpus directory as the command line does, writing the .vm files.
+void Benchmark::benchmarkDirectory(std::ostream& output, const Corpus& corpus) {
+    measure(output, "directory/" + corpus.name, corpus.lines, "lines", [&]() {
+        std::streambuf* console = std::cout.rdbuf(nullptr); // the progress messages
+        JackAnalyzer analyzer(corpus.dir.string(), options);
+        analyzer.generateVM();
+        std::cout.rdbuf(console);
+        std::cout.clear();
+    });
+}
+
+// Classifies keyword-dense words, two thirds of them keywords, with the perfect hash and, for
+// comparison, with the linear search and the hash map that the tokenizer used before it.
+void Benchmark::benchmarkKeyWords(std::ostream& output) {
+    std::vector<std::string> words;
+    Random random(7);
+    const std::vector<std::string> identifiers = {"x", "count", "Main", "this_", "classes", "dx", "thus", "index", "Memory", "letter"};
+    for (int i = 0; i < 3000; i++) {
+        if (random.below(3) < 2) {
+            words.emplace_back(keyWordNames[random.below(keyWordNames.size())]);
+        }
+        else {
+            words.push_back(identifiers[random.below(identifiers.size())]);
+        }
+    }
+    const int nLookups = 100000;
+    auto lookUp = [&](auto classify) {
+        int sum = 0;
+        for (int i = 0; i < nLookups; i++) {
+            sum += classify(words[i % words.size()]);
+        }
+        if (sum < 0) std::cout << sum; // keeps the loop from being optimized away
+    };
+    measure(output, "keywords/perfect-hash", nLookups, "lookups", [&]() {
+        lookUp([](const std::string& word) {
+            std::optional<KeyWord> keyWord = findKeyWord(word);
+            return keyWord ? static_cast<int>(*keyWord) : -1;
+        });
+    });
+    std::vector<std::string> keyWordList(keyWordNames.begin(), keyWordNames.end());
+    measure(output, "keywords/vector", nLookups, "lookups", [&]() {
+        lookUp([&keyWordList](const std::string& word) {
+            auto found = std::find(keyWordList.begin(), keyWordList.end(), word);
+            return found != keyWordList.end() ? static_cast<int>(found - keyWordList.begin()) : -1;
+        });
+    });
+    std::unordered_map<std::string, KeyWord> keyWordMap;
+    for (size_t keyWord = 0; keyWord < keyWordNames.size(); keyWord++) {
+        keyWordMap.emplace(keyWordNames[keyWord], static_cast<KeyWord>(keyWord));
+    }
+    measure(output, "keywords/unordered-map", nLookups, "lookups", [&]() {
+        lookUp([&keyWordMap](const std::string& word) {
+            auto found = keyWordMap.find(word);
+            return found != keyWordMap.end() ? static_cast<int>(found->second) : -1;
+        });
+    });
+}
+
+// Lookups in a subroutine-sized table, the mix the engine performs for every identifier.
+void Benchmark::benchmarkSymbolTable(std::ostream& output) {
+    SymbolTable table;
+    std::vector<std::string> names;
+    for (int i = 0; i < 32; i++) {
+        names.push_back("name" + std::to_string(i));
+        table.define(names.back(), "int", i % 2 ? VAR : ARG);
+    }
+    names.push_back("unknown"); // class-level names and subroutine calls miss
+    const int nLookups = 100000;
+    measure(output, "symbols/lookup", nLookups, "lookups", [&]() {
+        int sum = 0;
+        for (int i = 0; i < nLookups; i++) {
+            const std::string& name = names[i % names.size()];
+            if (table.kindOf(name) != NONE) sum += table.indexOf(name);
+        }
+        if (sum < 0) std::cout << sum; // keeps the loop from being optimized away
+    });
+}
+
+// Writes subroutine-sized batches of typical commands into each kind of sink.
+void Benchmark::benchmarkVMWriter(std::ostream& output) {
+    const int nCommands = 100000;
+    auto writeCommands = [nCommands](auto& writer) {
+        for (int i = 0; i < nCommands; i += 10) {
+            writer.writePush("local", i % 8);
+            writer.writePush("constant", i % 1000);
+            writer.writeArithmetic("add");
+            writer.writePop("pointer", 1);
+            writer.writePush("that", 0);
+            writer.writePush("argument", 1);
+            writer.writeCall("Math.multiply", 2);
+            writer.writePop("local", i % 8);
+            writer.writeLabel("L" + std::to_string(i % 50));
+            writer.writeIf("L" + std::to_string(i % 50));
+            if (i % 200 == 0) writer.flush();
+        }
+        writer.flush();
+    };
+    measure(output, "vmwriter/memory", nCommands, "commands", [&]() {
+        VMWriter<MemorySink> writer;
+        writeCommands(writer);
+    });
+    measure(output, "vmwriter/null", nCommands, "commands", [&]() {
+        VMWriter<NullSink> writer;
+        writeCommands(writer);
+    });
+    measure(output, "vmwriter/hash", nCommands, "commands", [&]() {
+        VMWriter<HashSink> writer;
+        writeCommands(writer);
+        if (writer.getSink().digest() == 0) std::cout << ""; // keeps the digest from being optimized away
+    });
+    std::filesystem::path file = workDir / "VMWriter.vm";
+    measure(output, "vmwriter/file", nCommands, "commands", [&]() {
+        VMWriter<FileSink> writer(file);
+        writeCommands(writer);
+        writer.close();
+    });
+    std::filesystem::remove(file);
+}
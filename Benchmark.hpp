@@ -0,0 +1,54 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "CompilerOptions.hpp"
+
+// The --benchmark suite. Generates synthetic Jack projects under a work directory, then times
+// each stage of the compiler on them: lexing, parsing and code generation, keyword and
+// symbol table lookups, VM output, and whole-directory builds. The projects depend only on
+// the scale, so runs on different revisions compile the same code.
+//
+// Results are printed one per line, always in the same order:
+//
+//   <benchmark>\t<iterations>\t<ns> ns/op\t<rate> <unit>/s
+//
+// where ns/op is the fastest iteration and the rate is derived from it.
+//
+// The alloc-* projects are complete programs that allocate and free many small objects. The
+// suite only times their compilation; tests/alloc_linked_list and tests/alloc_particles run
+// them on the VM emulator with and without --bump-alloc and bound their cost.
+class Benchmark {
+public:
+    Benchmark(std::filesystem::path workDir, int scale, CompilerOptions options);
+    void run(std::ostream& output);
+private:
+    // One generated project.
+    struct Corpus {
+        std::string name;
+        std::filesystem::path dir;
+        std::vector<std::filesystem::path> files;
+        std::vector<std::string> sources; // file contents, for the stages that take no path
+        long lines;
+        size_t bytes;
+    };
+
+    void generate();
+    Corpus& addCorpus(const std::string& name);
+    void addSource(Corpus& corpus, const std::string& className, std::string source);
+    void measure(std::ostream& output, const std::string& name, double items, const std::string& unit, const std::function<void()>& operation);
+    void benchmarkLexer(std::ostream& output, const Corpus& corpus);
+    void benchmarkCompiler(std::ostream& output, const Corpus& corpus);
+    void benchmarkDirectory(std::ostream& output, const Corpus& corpus);
+    void benchmarkKeyWords(std::ostream& output);
+    void benchmarkSymbolTable(std::ostream& output);
+    void benchmarkVMWriter(std::ostream& output);
+
+    std::filesystem::path workDir;
+    int scale;
+    CompilerOptions options;
+    std::vector<Corpus> corpora;
+};
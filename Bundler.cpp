@@ -0,0 +1,102 @@
+#include "Bundler.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+Bundler::Bundler(const Profiler& profiler) : profiler(profiler), nStatics(0), hasPositions(false) {}
+
+// Splits the output of one class into its functions, moving its statics after those of the
+// classes added before it.
+void Bundler::addClass(const std::string& vmCode, const LineMap& lineMap) {
+    std::istringstream input(vmCode);
+    std::string line;
+    int classStatics = 0;
+    Function* function = nullptr;
+    while (std::getline(input, line)) {
+        std::istringstream words(line);
+        std::string command, arg;
+        int index = 0;
+        words >> command >> arg >> index;
+        if (command == "function") {
+            functionIndex[arg] = functions.size();
+            const FunctionPositions* positions = lineMap.find(arg);
+            functions.push_back({arg, "", 0, {}, positions ? *positions : FunctionPositions{arg, "", {}}});
+            function = &functions.back();
+            hasPositions = hasPositions || positions;
+        }
+        if (!function) {
+            throw std::runtime_error("Bundler: VM code found outside of a function.");
+        }
+        if ((command == "push" || command == "pop") && arg == "static") {
+            classStatics = std::max(classStatics, index + 1);
+            line = command + " static " + std::to_string(nStatics + index);
+        }
+        else if (command == "call" && std::find(function->callees.begin(), function->callees.end(), arg) == function->callees.end()) {
+            function->callees.push_back(arg);
+        }
+        function->code += line + '\n';
+        function->nCommands++;
+    }
+    nStatics += classStatics;
+}
+
+std::vector<size_t> Bundler::order() {
+    std::vector<size_t> order;
+    std::vector<bool> placed(functions.size(), false);
+    auto root = functionIndex.find("Sys.init");
+    if (root == functionIndex.end()) root = functionIndex.find("Main.main");
+
+    if (root != functionIndex.end()) {
+        // preorder depth-first walk with an explicit stack of (function, next callee)
+        std::vector<std::pair<size_t, size_t>> stack = {{root->second, 0}};
+        placed[root->second] = true;
+        order.push_back(root->second);
+        while (!stack.empty()) {
+            std::vector<std::string>& callees = functions[stack.back().first].callees;
+            if (stack.back().second == 0) {
+                std::stable_sort(callees.begin(), callees.end(), [this](const std::string& a, const std::string& b) {
+                    return profiler.count(a) > profiler.count(b);
+                });
+            }
+            if (stack.back().second == callees.size()) {
+                stack.pop_back();
+                continue;
+            }
+            auto callee = functionIndex.find(callees[stack.back().second++]);
+            if (callee == functionIndex.end() || placed[callee->second]) continue; // OS routine or already placed
+            placed[callee->second] = true;
+            order.push_back(callee->second);
+            stack.push_back({callee->second, 0});
+        }
+    }
+
+    std::vector<size_t> unreached;
+    for (size_t i = 0; i < functions.size(); i++) {
+        if (!placed[i]) unreached.push_back(i);
+    }
+    std::sort(unreached.begin(), unreached.end(), [this](size_t a, size_t b) {
+        return functions[a].name < functions[b].name;
+    });
+    order.insert(order.end(), unreached.begin(), unreached.end());
+    return order;
+}
+
+void Bundler::write(std::filesystem::path outputPath) {
+    std::ofstream output(outputPath);
+    if (!output) {
+        throw std::runtime_error("Bundler: unable to open " + outputPath.string() + " for writing.");
+    }
+    LineMap lineMap;
+    for (size_t i : order()) {
+        output << functions[i].code;
+        std::vector<SourcePosition>& positions = functions[i].positions.positions;
+        if (hasPositions && positions.size() < functions[i].nCommands) {
+            positions.resize(functions[i].nCommands, {0, 0}); // generated code without a line map
+        }
+        lineMap.addFunction(functions[i].positions);
+    }
+    if (hasPositions) {
+        lineMap.write(outputPath.string() + ".map");
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Profiler.hpp"
+#include "LineMap.hpp"
+
+// Joins the compiled classes of a program into a single .vm file. Static variables are
+// renumbered so that each class keeps its own, and functions are ordered by the call graph:
+// starting from Sys.init (or Main.main), each function is followed by the callees it reaches
+// first, hottest first when there is a profile; functions never reached come last, by name.
+// Line maps of the classes are reordered along with their functions.
+class Bundler {
+public:
+    Bundler(const Profiler& profiler);
+    void addClass(const std::string& vmCode, const LineMap& lineMap);
+    void write(std::filesystem::path outputPath);
+private:
+    struct Function {
+        std::string name;
+        std::string code;
+        size_t nCommands; // lines of code
+        std::vector<std::string> callees; // in order of their first call
+        FunctionPositions positions;
+    };
+
+    std::vector<size_t> order();
+
+    const Profiler& profiler;
+    std::vector<Function> functions;
+    std::unordered_map<std::string, size_t> functionIndex;
+    int nStatics; // statics used by the classes added so far
+    bool hasPositions; // some class came with a line map, so the bundle gets one too
+};
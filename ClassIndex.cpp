@@ -0,0 +1,271 @@
+#include "ClassIndex.hpp"
+#include "JackTokenizer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char indexMagic[4] = {'J', 'K', 'I', 'X'};
+    const uint32_t indexVersion = 2;
+
+    // Reads the fixed-width fields of a mapped index, failing on truncated data.
+    class IndexReader {
+    public:
+        IndexReader(const char* data, size_t size) : data(data), size(size), offset(0) {}
+        template <typename T> T read() {
+            T value;
+            if (size - offset < sizeof(T)) throw std::runtime_error("ClassIndex: the index file is truncated.");
+            std::memcpy(&value, data + offset, sizeof(T));
+            offset += sizeof(T);
+            return value;
+        }
+        std::string readString() {
+            uint32_t length = read<uint32_t>();
+            if (size - offset < length) throw std::runtime_error("ClassIndex: the index file is truncated.");
+            std::string value(data + offset, length);
+            offset += length;
+            return value;
+        }
+    private:
+        const char* data;
+        size_t size;
+        size_t offset;
+    };
+
+    template <typename T> void append(std::string& buffer, T value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void appendString(std::string& buffer, const std::string& value) {
+        append<uint32_t>(buffer, value.size());
+        buffer += value;
+    }
+}
+
+// Loads the persisted index of `projectDir`, rescans the .jack files that were added or changed
+// since it was written, and writes it back if anything changed.
+ClassIndex::ClassIndex(std::filesystem::path projectDir, const SourceReader& readSource) : indexPath(projectDir / ".jackindex"), rescannedCount(0) {
+    bool loaded = load();
+    std::unordered_map<std::string, std::string> classOfFile;
+    for (const auto& entry : classes) {
+        classOfFile[entry.second.fileName] = entry.first;
+    }
+
+    std::unordered_map<std::string, ClassSignature> current;
+    for (const auto& entry : std::filesystem::directory_iterator(projectDir)) {
+        if (!entry.is_regular_file() || entry.path().extension().string() != ".jack") continue;
+        std::string fileName = entry.path().filename().string();
+        int64_t modified = entry.last_write_time().time_since_epoch().count();
+        uint64_t size = entry.file_size();
+        auto known = classOfFile.find(fileName);
+        if (known != classOfFile.end()) {
+            ClassSignature& signature = classes[known->second];
+            if (signature.modified == modified && signature.size == size) {
+                current[known->second] = std::move(signature);
+                continue;
+            }
+        }
+        ClassSignature signature{fileName, modified, size, 0, false, {}};
+        std::string className = scan(readSource(entry.path()), signature);
+        rescannedCount++;
+        if (!className.empty()) {
+            current[className] = std::move(signature);
+        }
+    }
+    bool changed = !loaded || rescannedCount > 0 || current.size() != classes.size();
+    classes = std::move(current);
+    if (changed) {
+        save();
+    }
+}
+
+const ClassSignature* ClassIndex::findClass(const std::string& className) const {
+    auto found = classes.find(className);
+    return found == classes.end() ? nullptr : &found->second;
+}
+
+const SubroutineSignature* ClassIndex::find(const std::string& className, const std::string& subroutineName) const {
+    const ClassSignature* signature = findClass(className);
+    if (!signature) return nullptr;
+    auto found = signature->subroutines.find(subroutineName);
+    return found == signature->subroutines.end() ? nullptr : &found->second;
+}
+
+const SubroutineSignature* ClassIndex::find(const std::string& functionName) const {
+    size_t dot = functionName.find('.');
+    if (dot == std::string::npos) return nullptr;
+    return find(functionName.substr(0, dot), functionName.substr(dot + 1));
+}
+
+int ClassIndex::rescanned() {
+    return rescannedCount;
+}
+
+// Maps the persisted index into memory and reads it. Returns false, leaving the index empty,
+// when there is no index yet or it was written by another version of the compiler.
+bool ClassIndex::load() {
+    int fd = open(indexPath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = status.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    bool loaded = false;
+    try {
+        IndexReader reader(static_cast<const char*>(mapped), size);
+        char magic[4];
+        for (char& c : magic) c = reader.read<char>();
+        if (std::memcmp(magic, indexMagic, 4) == 0 && reader.read<uint32_t>() == indexVersion) {
+            uint32_t nClasses = reader.read<uint32_t>();
+            for (uint32_t i = 0; i < nClasses; i++) {
+                std::string className = reader.readString();
+                ClassSignature& signature = classes[className];
+                signature.fileName = reader.readString();
+                signature.modified = reader.read<int64_t>();
+                signature.size = reader.read<uint64_t>();
+                signature.nFields = reader.read<uint32_t>();
+                signature.releasesThis = reader.read<uint8_t>() != 0;
+                uint32_t nSubroutines = reader.read<uint32_t>();
+                for (uint32_t j = 0; j < nSubroutines; j++) {
+                    std::string name = reader.readString();
+                    KeyWord kind = static_cast<KeyWord>(reader.read<uint32_t>());
+                    int nParameters = reader.read<uint32_t>();
+                    signature.subroutines[name] = {kind, nParameters};
+                }
+            }
+            loaded = true;
+        }
+    }
+    catch (const std::runtime_error&) {
+        classes.clear(); // a damaged index is rebuilt from the sources
+    }
+    munmap(mapped, size);
+    return loaded;
+}
+
+// Writes the index, with classes and subroutines sorted so the file is reproducible. The index
+// is only a cache: if the project directory is not writable, it is rebuilt on the next run.
+void ClassIndex::save() {
+    std::vector<std::string> classNames;
+    for (const auto& entry : classes) {
+        classNames.push_back(entry.first);
+    }
+    std::sort(classNames.begin(), classNames.end());
+
+    std::string buffer(indexMagic, 4);
+    append<uint32_t>(buffer, indexVersion);
+    append<uint32_t>(buffer, classNames.size());
+    for (const std::string& className : classNames) {
+        const ClassSignature& signature = classes.at(className);
+        appendString(buffer, className);
+        appendString(buffer, signature.fileName);
+        append<int64_t>(buffer, signature.modified);
+        append<uint64_t>(buffer, signature.size);
+        append<uint32_t>(buffer, signature.nFields);
+        append<uint8_t>(buffer, signature.releasesThis);
+        std::vector<std::string> names;
+        for (const auto& subroutine : signature.subroutines) {
+            names.push_back(subroutine.first);
+        }
+        std::sort(names.begin(), names.end());
+        append<uint32_t>(buffer, names.size());
+        for (const std::string& name : names) {
+            appendString(buffer, name);
+            append<uint32_t>(buffer, signature.subroutines.at(name).kind);
+            append<uint32_t>(buffer, signature.subroutines.at(name).nParameters);
+        }
+    }
+
+    std::filesystem::path temporaryPath = indexPath;
+    temporaryPath += ".tmp";
+    std::ofstream output(temporaryPath, std::ios::binary);
+    if (!output) return;
+    output.write(buffer.data(), buffer.size());
+    output.close();
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, indexPath, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+    }
+}
+
+// Reads the class header, the class variable declarations and the subroutine headers of the
+// class in `source`, skipping subroutine bodies except to note whether a method releases `this`.
+// Returns the class name, or an empty string when the headers cannot be parsed; the compilation
+// engine reports the actual error.
+std::string ClassIndex::scan(const std::string& source, ClassSignature& signature) {
+    JackTokenizer tokenizer(source, 0, 1);
+    auto next = [&tokenizer]() {
+        if (!tokenizer.hasMoreTokens()) return false;
+        tokenizer.advance();
+        return true;
+    };
+    auto isToken = [&tokenizer](const char* token) { return tokenizer.currentToken == token; };
+
+    if (!next() || !isToken("class") || !next()) return "";
+    std::string className = tokenizer.currentToken;
+    if (!next() || !isToken("{") || !next()) return "";
+    while (!isToken("}")) {
+        if (isToken("static") || isToken("field")) {
+            bool isField = isToken("field");
+            if (!next()) return ""; // type
+            do {
+                if (!next()) return ""; // varName
+                if (isField) signature.nFields++;
+                if (!next()) return "";
+            } while (isToken(","));
+            if (!isToken(";") || !next()) return "";
+        }
+        else if (isToken("const") || isToken("enum")) {
+            // --constants declarations take no storage
+            const char* end = isToken("const") ? ";" : "}";
+            while (!isToken(end)) {
+                if (!next()) return "";
+            }
+            if (!next()) return "";
+            if (isToken(";") && !next()) return "";
+        }
+        else if (isToken("constructor") || isToken("function") || isToken("method")) {
+            KeyWord kind = tokenizer.keyWord();
+            if (!next() || !next()) return ""; // type
+            std::string name = tokenizer.currentToken;
+            if (!next() || !isToken("(") || !next()) return "";
+            int nParameters = isToken(")") ? 0 : 1;
+            while (!isToken(")")) {
+                if (isToken(",")) nParameters++;
+                if (!next()) return "";
+            }
+            signature.subroutines[name] = {kind, nParameters};
+            if (!next() || !isToken("{")) return "";
+            const char* release[] = {"Memory", ".", "deAlloc", "(", "this", ")"};
+            size_t matched = 0;
+            int depth = 0;
+            do {
+                if (isToken("{")) depth++;
+                if (isToken("}")) depth--;
+                matched = isToken(release[matched]) ? matched + 1 : isToken(release[0]) ? 1 : 0;
+                if (matched == std::size(release)) {
+                    if (kind == KW_METHOD) signature.releasesThis = true;
+                    matched = 0;
+                }
+                if (!next()) return "";
+            } while (depth > 0);
+        }
+        else {
+            return "";
+        }
+    }
+    return className;
+}
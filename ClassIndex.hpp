@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Enums.hpp"
+
+struct SubroutineSignature {
+    KeyWord kind;    // KW_CONSTRUCTOR, KW_FUNCTION or KW_METHOD
+    int nParameters; // declared parameters, not counting `this`
+};
+
+struct ClassSignature {
+    std::string fileName; // the .jack file the class was read from
+    int64_t modified;     // its last write time and size when it was scanned
+    uint64_t size;
+    int nFields;
+    bool releasesThis;    // a method calls Memory.deAlloc(this)
+    std::unordered_map<std::string, SubroutineSignature> subroutines;
+};
+
+// The signatures of every class in a project directory. Only class and subroutine headers are
+// read, and the result is persisted next to the sources so that later builds rescan only the
+// files that changed since.
+class ClassIndex {
+public:
+    // `readSource` returns the contents of a .jack file of the directory.
+    using SourceReader = std::function<const std::string&(const std::filesystem::path&)>;
+    ClassIndex(std::filesystem::path projectDir, const SourceReader& readSource);
+    const ClassSignature* findClass(const std::string& className) const;
+    const SubroutineSignature* find(const std::string& className, const std::string& subroutineName) const;
+    const SubroutineSignature* find(const std::string& functionName) const; // Class.subroutine
+    int rescanned(); // sources read by the constructor because their index entry was missing or stale
+private:
+    bool load();
+    void save();
+    std::string scan(const std::string& source, ClassSignature& signature);
+
+    std::filesystem::path indexPath;
+    std::unordered_map<std::string, ClassSignature> classes; // by class name
+    int rescannedCount;
+};
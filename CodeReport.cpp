@@ -0,0 +1,171 @@
+#include "CodeReport.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+    std::string opcodeName(const VMCommand& command) {
+        switch (command.op) {
+            case VM_PUSH: return "push";
+            case VM_POP: return "pop";
+            case VM_ARITHMETIC: return command.arg;
+            case VM_LABEL: return "label";
+            case VM_GOTO: return "goto";
+            case VM_IF: return "if-goto";
+            case VM_CALL: return "call";
+            case VM_FUNCTION: return "function";
+            case VM_RETURN: return "return";
+        }
+        return "";
+    }
+
+    std::string quoted(const std::string& text) {
+        std::string result = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') result += '\\';
+            result += c;
+        }
+        return result + "\"";
+    }
+
+    void add(SubroutineMetrics& total, const SubroutineMetrics& metrics) {
+        for (const auto& opcode : metrics.opcodes) {
+            total.opcodes[opcode.first] += opcode.second;
+        }
+        total.commands += metrics.commands;
+        total.calls += metrics.calls;
+        total.multiplyCalls += metrics.multiplyCalls;
+        total.divideCalls += metrics.divideCalls;
+        total.appendCharCalls += metrics.appendCharCalls;
+        total.userCalls += metrics.userCalls;
+        total.osCalls += metrics.osCalls;
+        total.locals += metrics.locals;
+        total.stringBytes += metrics.stringBytes;
+        total.hackInstructions += metrics.hackInstructions;
+    }
+}
+
+// Measures the final code of one subroutine, starting at its `function` command. The VM code
+// cannot tell string constants from explicit appendChar calls, so the compiler counts their
+// characters and passes them as `stringBytes`.
+SubroutineMetrics CodeReport::measure(const std::string& name, const std::vector<VMCommand>& commands, int stringBytes, const ClassIndex& classIndex, Optimizer& optimizer) {
+    SubroutineMetrics metrics{name, {}, 0, 0, 0, 0, 0, 0, 0, 0, stringBytes, 0};
+    for (const VMCommand& command : commands) {
+        metrics.opcodes[opcodeName(command)]++;
+        metrics.commands++;
+        metrics.hackInstructions += optimizer.estimatedCost(command);
+        if (command.op == VM_FUNCTION) {
+            metrics.locals = command.index;
+        }
+        else if (command.op == VM_CALL) {
+            metrics.calls++;
+            if (command.arg == "Math.multiply") metrics.multiplyCalls++;
+            else if (command.arg == "Math.divide") metrics.divideCalls++;
+            else if (command.arg == "String.appendChar") metrics.appendCharCalls++;
+            else if (classIndex.findClass(command.arg.substr(0, command.arg.find('.')))) metrics.userCalls++;
+            else metrics.osCalls++;
+        }
+    }
+    return metrics;
+}
+
+void CodeReport::addClass(const std::string& fileName, const std::vector<SubroutineMetrics>& subroutines) {
+    if (subroutines.empty()) return;
+    std::string className = subroutines.front().name.substr(0, subroutines.front().name.find('.'));
+    ClassMetrics metrics{className, fileName, subroutines, {className, {}, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    for (const SubroutineMetrics& subroutine : subroutines) {
+        add(metrics.total, subroutine);
+    }
+    classes.push_back(std::move(metrics));
+}
+
+void CodeReport::write(std::filesystem::path projectDir) {
+    std::sort(classes.begin(), classes.end(), [](const ClassMetrics& a, const ClassMetrics& b) {
+        return a.name < b.name;
+    });
+    writeJson(projectDir / "CodeReport.json");
+    writeTable(projectDir / "CodeReport.txt");
+}
+
+// One object per class, holding its totals and its subroutines in source order.
+void CodeReport::writeJson(std::filesystem::path path) {
+    std::ofstream output(path);
+    if (!output) {
+        throw std::runtime_error("CodeReport: unable to write " + path.string() + ".");
+    }
+    auto writeMetrics = [&output](const SubroutineMetrics& metrics, const std::string& indent) {
+        output << indent << "\"name\": " << quoted(metrics.name) << ",\n";
+        output << indent << "\"commands\": " << metrics.commands << ",\n";
+        output << indent << "\"opcodes\": {";
+        bool first = true;
+        for (const auto& opcode : metrics.opcodes) {
+            output << (first ? "" : ", ") << quoted(opcode.first) << ": " << opcode.second;
+            first = false;
+        }
+        output << "},\n";
+        output << indent << "\"calls\": {\"total\": " << metrics.calls
+            << ", \"Math.multiply\": " << metrics.multiplyCalls
+            << ", \"Math.divide\": " << metrics.divideCalls
+            << ", \"String.appendChar\": " << metrics.appendCharCalls
+            << ", \"user\": " << metrics.userCalls
+            << ", \"os\": " << metrics.osCalls << "},\n";
+        output << indent << "\"locals\": " << metrics.locals << ",\n";
+        output << indent << "\"stringBytes\": " << metrics.stringBytes << ",\n";
+        output << indent << "\"hackInstructions\": " << metrics.hackInstructions;
+    };
+
+    output << "{\n  \"classes\": [";
+    for (size_t i = 0; i < classes.size(); i++) {
+        output << (i ? ",\n" : "\n") << "    {\n";
+        output << "      \"file\": " << quoted(classes[i].fileName) << ",\n";
+        writeMetrics(classes[i].total, "      ");
+        output << ",\n      \"subroutines\": [";
+        for (size_t j = 0; j < classes[i].subroutines.size(); j++) {
+            output << (j ? ",\n" : "\n") << "        {\n";
+            writeMetrics(classes[i].subroutines[j], "          ");
+            output << "\n        }";
+        }
+        output << "\n      ]\n    }";
+    }
+    output << "\n  ]\n}\n";
+}
+
+// Subroutines, then class totals, each sorted by estimated Hack instructions, largest first.
+void CodeReport::writeTable(std::filesystem::path path) {
+    std::ofstream output(path);
+    if (!output) {
+        throw std::runtime_error("CodeReport: unable to write " + path.string() + ".");
+    }
+    auto byCost = [](const SubroutineMetrics& a, const SubroutineMetrics& b) {
+        if (a.hackInstructions != b.hackInstructions) return a.hackInstructions > b.hackInstructions;
+        return a.name < b.name;
+    };
+    auto writeRows = [&output](const char* title, std::vector<SubroutineMetrics> rows, decltype(byCost) order) {
+        std::sort(rows.begin(), rows.end(), order);
+        size_t width = 10;
+        for (const SubroutineMetrics& row : rows) {
+            width = std::max(width, row.name.size());
+        }
+        char line[512];
+        std::snprintf(line, sizeof(line), "%-*s %7s %6s %6s %6s %6s %6s %6s %6s %6s %7s\n", static_cast<int>(width), title,
+            "hack", "vm", "calls", "mul", "div", "chr", "user", "os", "locals", "strings");
+        output << line;
+        for (const SubroutineMetrics& row : rows) {
+            std::snprintf(line, sizeof(line), "%-*s %7d %6d %6d %6d %6d %6d %6d %6d %6d %7d\n", static_cast<int>(width), row.name.c_str(),
+                row.hackInstructions, row.commands, row.calls, row.multiplyCalls, row.divideCalls, row.appendCharCalls,
+                row.userCalls, row.osCalls, row.locals, row.stringBytes);
+            output << line;
+        }
+    };
+
+    std::vector<SubroutineMetrics> subroutines;
+    std::vector<SubroutineMetrics> totals;
+    for (const ClassMetrics& metrics : classes) {
+        subroutines.insert(subroutines.end(), metrics.subroutines.begin(), metrics.subroutines.end());
+        totals.push_back(metrics.total);
+    }
+    writeRows("subroutine", subroutines, byCost);
+    output << '\n';
+    writeRows("class", totals, byCost);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+#include "ClassIndex.hpp"
+#include "Optimizer.hpp"
+#include "VMWriter.hpp"
+
+// The size of the code generated for one subroutine, measured after optimization.
+struct SubroutineMetrics {
+    std::string name;                   // Class.subroutine
+    std::map<std::string, int> opcodes; // commands by opcode, arithmetic by operator
+    int commands;                       // VM commands, labels included
+    int calls;
+    int multiplyCalls;                  // runtime helpers: Math.multiply, Math.divide, String.appendChar
+    int divideCalls;
+    int appendCharCalls;
+    int userCalls;                      // subroutines of classes in the project
+    int osCalls;                        // any other OS routine
+    int locals;                         // after local packing
+    int stringBytes;                    // characters of the string constants in the source
+    int hackInstructions;               // estimated, see Optimizer::estimatedCost
+};
+
+// Collects the metrics of every compiled subroutine for --code-report and writes them to the
+// project directory as CodeReport.json, for tools, and CodeReport.txt, a table sorted by
+// estimated Hack instructions so that the largest subroutines come first.
+class CodeReport {
+public:
+    static SubroutineMetrics measure(const std::string& name, const std::vector<VMCommand>& commands, int stringBytes, const ClassIndex& classIndex, Optimizer& optimizer);
+    void addClass(const std::string& fileName, const std::vector<SubroutineMetrics>& subroutines);
+    void write(std::filesystem::path projectDir);
+private:
+    struct ClassMetrics {
+        std::string name;
+        std::string fileName;
+        std::vector<SubroutineMetrics> subroutines; // in source order
+        SubroutineMetrics total;                    // sums, named after the class
+    };
+
+    void writeJson(std::filesystem::path path);
+    void writeTable(std::filesystem::path path);
+
+    std::vector<ClassMetrics> classes;
+};
@@ -1,56 +1,162 @@
 #include "CompilationEngine.hpp"
+#include "KeyWords.hpp"
 #include <filesystem>
 #include <fstream>
 #include <stdexcept>
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <exception>
 
-CompilationEngine::CompilationEngine(std::filesystem::path inputPath, std::filesystem::path outputPath) : tokenizer(inputPath), classSymbolTable(), subroutineSymbolTable(), labelNumber(0), vmWriter(outputPath) {
+CompilationEngine::CompilationEngine(std::filesystem::path inputPath, const ClassIndex& classIndex, Profiler& profiler, CompilerOptions options) : tokenizer(inputPath), classSymbolTable(), subroutineSymbolTable(), labelNumber(0), thatReuses(0), vmWriter(), classIndex(classIndex), profiler(profiler), options(options) {
     currentClass = "Main";
-    inputStream = std::ifstream(inputPath);
-    if (!inputStream) throw std::runtime_error("CompilationEngine: the input file could not be read from.");
-
-    keyWordToStr = {
-        {KW_CLASS, "class"},
-        {KW_METHOD, "method"},
-        {KW_FUNCTION, "function"},
-        {KW_CONSTRUCTOR, "constructor"},
-        {KW_INT, "int"},
-        {KW_BOOLEAN, "boolean"},
-        {KW_CHAR, "char"},
-        {KW_VOID, "void"},
-        {KW_VAR, "var"},
-        {KW_STATIC, "static"},
-        {KW_FIELD, "field"},
-        {KW_LET, "let"},
-        {KW_DO, "do"},
-        {KW_IF, "if"},
-        {KW_ELSE, "else"},
-        {KW_WHILE, "while"},
-        {KW_RETURN, "return"},
-        {KW_TRUE, "true"},
-        {KW_FALSE, "false"},
-        {KW_NULL, "null"},
-        {KW_THIS, "this"}
-    };
+    sourceName = inputPath.filename().string();
+    initialize();
+}
+
+CompilationEngine::CompilationEngine(std::filesystem::path inputPath, std::string source, const ClassIndex& classIndex, Profiler& profiler, CompilerOptions options) : tokenizer(std::move(source), 0, 1), classSymbolTable(), subroutineSymbolTable(), labelNumber(0), thatReuses(0), vmWriter(), classIndex(classIndex), profiler(profiler), options(options) {
+    currentClass = "Main";
+    sourceName = inputPath.filename().string();
+    initialize();
+}
+
+CompilationEngine::CompilationEngine(std::string source, int firstLine, int firstColumn, std::string className, const SymbolTable& classSymbolTable, const ClassIndex& classIndex, Profiler& profiler, CompilerOptions options) : tokenizer(std::move(source), firstLine, firstColumn), classSymbolTable(classSymbolTable), subroutineSymbolTable(), labelNumber(0), thatReuses(0), vmWriter(), classIndex(classIndex), profiler(profiler), options(options) {
+    currentClass = className;
+    initialize();
+}
+
+// The VM code of an engine that compiles into memory.
+std::string CompilationEngine::output() {
+    return vmWriter.contents();
+}
+
+// The size of every compiled subroutine in source order, collected with --code-report.
+const std::vector<SubroutineMetrics>& CompilationEngine::getMetrics() {
+    return metrics;
+}
+
+// The source positions of the compiled code, collected with --line-map.
+LineMap& CompilationEngine::getLineMap() {
+    return vmWriter.getLineMap();
+}
 
+void CompilationEngine::initialize() {
+    if (options.lineMap && !sourceName.empty()) {
+        vmWriter.recordPositions(sourceName);
+    }
+    if (options.bumpRegion > 0) {
+        optimizer.reserveTemps(6); // the allocation region
+    }
     tokenizer.advance();
 }
 
 void CompilationEngine::compileClass() {
     classSymbolTable.reset();
-    writeKeyWord(); // class
+    writeKeyWord(KW_CLASS);
     currentClass = tokenizer.identifier();
     writeIdentifier(); // className
     writeSymbol(); // {
-    while (tokenizer.tokenType() == KEYWORD && (tokenizer.keyWord() == KW_STATIC || tokenizer.keyWord() == KW_FIELD)) {
-        compileClassVarDec();
+    while ((tokenizer.tokenType() == KEYWORD && (tokenizer.keyWord() == KW_STATIC || tokenizer.keyWord() == KW_FIELD)) || isConstantDec()) {
+        if (isConstantDec()) {
+            compileConstantDec();
+        }
+        else {
+            compileClassVarDec();
+        }
     }
-    while (tokenizer.tokenType() == KEYWORD && (tokenizer.keyWord() == KW_CONSTRUCTOR || tokenizer.keyWord() == KW_FUNCTION || tokenizer.keyWord() == KW_METHOD)) {
-        compileSubroutineDec();
+    if (options.jobs > 1 || profiler.hasCounts()) {
+        compileSubroutineSlices();
+    }
+    else {
+        while (tokenizer.tokenType() == KEYWORD && (tokenizer.keyWord() == KW_CONSTRUCTOR || tokenizer.keyWord() == KW_FUNCTION || tokenizer.keyWord() == KW_METHOD)) {
+            compileSubroutineDec();
+        }
     }
     writeSymbol(); // }
+    std::cout << report.str();
+}
+
+// Subroutine bodies only depend on the class symbol table, which is complete once the
+// class variables have been compiled. Splits the rest of the class at each top-level
+// subroutine keyword, compiles the slices on separate threads into their own writers,
+// then writes the results in source order, or hottest first when there is a profile.
+void CompilationEngine::compileSubroutineSlices() {
+    struct SubroutineSource {
+        size_t start;
+        int line;
+        int column;
+    };
+    std::vector<SubroutineSource> subroutines;
+    int depth = 0;
+    while (depth > 0 || tokenizer.currentToken != "}") {
+        if (depth == 0 && (tokenizer.currentToken == "constructor" || tokenizer.currentToken == "function" || tokenizer.currentToken == "method")) {
+            subroutines.push_back({tokenizer.tokenPosition(), tokenizer.tokenLineNumber(), tokenizer.tokenColumnNumber()});
+        }
+        if (tokenizer.currentToken == "{") depth++;
+        if (tokenizer.currentToken == "}") depth--;
+        if (!tokenizer.hasMoreTokens()) {
+            throw std::runtime_error("Error at line " + std::to_string(tokenizer.getLineNumber()) + ": the class body is not closed.");
+        }
+        tokenizer.advance();
+    }
+    size_t classEnd = tokenizer.tokenPosition();
+
+    size_t count = subroutines.size();
+    std::vector<std::string> outputs(count);
+    std::vector<std::string> reports(count);
+    std::vector<std::string> names(count);
+    std::vector<LineMap> lineMaps(count);
+    std::vector<std::vector<SubroutineMetrics>> subroutineMetrics(count);
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<size_t> next(0);
+    auto compileNext = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                size_t end = i + 1 < count ? subroutines[i + 1].start : classEnd;
+                std::string source = tokenizer.getSource().substr(subroutines[i].start, end - subroutines[i].start);
+                CompilationEngine engine(source, subroutines[i].line, subroutines[i].column, currentClass, classSymbolTable, classIndex, profiler, options);
+                if (options.lineMap) {
+                    engine.vmWriter.recordPositions(sourceName);
+                }
+                engine.compileSubroutineDec();
+                outputs[i] = engine.output();
+                reports[i] = engine.report.str();
+                names[i] = engine.currentSubroutine;
+                lineMaps[i] = engine.getLineMap();
+                subroutineMetrics[i] = engine.metrics;
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    size_t nThreads = options.instrument ? 1 : options.jobs; // counters are numbered in source order
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(nThreads, count); t++) {
+        threads.emplace_back(compileNext);
+    }
+    compileNext();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::vector<size_t> order;
+    for (size_t i = 0; i < count; i++) {
+        if (errors[i]) std::rethrow_exception(errors[i]);
+        order.push_back(i);
+        report << reports[i];
+        metrics.insert(metrics.end(), subroutineMetrics[i].begin(), subroutineMetrics[i].end());
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return profiler.count(names[a]) > profiler.count(names[b]);
+    });
+    for (size_t i : order) {
+        vmWriter.writeRaw(outputs[i]);
+        vmWriter.getLineMap().append(lineMaps[i]);
+    }
 }
 
 void CompilationEngine::compileClassVarDec() {
@@ -68,15 +174,83 @@ void CompilationEngine::compileClassVarDec() {
     writeSymbol(); // ;
 }
 
+// const type name = expression (, name = expression)* ;
+// enum name { name (= expression)? (, name (= expression)?)* } ;?
+// Enum members count up from 0, or from the value of the previous member. Both define class
+// constants, which are compiled as `push constant`.
+void CompilationEngine::compileConstantDec() {
+    if (tokenizer.currentToken == "const") {
+        tokenizer.advance(); // const
+        std::string type = tokenizer.type();
+        writeType(); // type
+        while (true) {
+            std::string name = tokenizer.identifier();
+            writeIdentifier(); // name
+            writeSymbol(); // =
+            classSymbolTable.defineConstant(name, type, evaluateConstant());
+            if (tokenizer.tokenType() != SYMBOL || tokenizer.symbol() != ',') break;
+            writeSymbol(); // ,
+        }
+        writeSymbol(); // ;
+        return;
+    }
+    tokenizer.advance(); // enum
+    std::string type = tokenizer.identifier();
+    writeIdentifier(); // name
+    writeSymbol(); // {
+    int value = 0;
+    while (tokenizer.tokenType() == IDENTIFIER) {
+        std::string name = tokenizer.identifier();
+        writeIdentifier(); // name
+        if (tokenizer.tokenType() == SYMBOL && tokenizer.symbol() == '=') {
+            writeSymbol(); // =
+            value = evaluateConstant();
+        }
+        classSymbolTable.defineConstant(name, type, value++);
+        if (tokenizer.tokenType() != SYMBOL || tokenizer.symbol() != ',') break;
+        writeSymbol(); // ,
+    }
+    writeSymbol(); // }
+    if (tokenizer.tokenType() == SYMBOL && tokenizer.symbol() == ';') {
+        writeSymbol(); // ;
+    }
+}
+
+// Compiles the initializer of a constant and returns its value; it may only use literals,
+// earlier constants and operators, which fold to a single constant.
+int CompilationEngine::evaluateConstant() {
+    size_t start = vmWriter.mark();
+    compileExpression();
+    size_t constantStart;
+    int value;
+    bool isConstant = trailingConstant(vmWriter.mark(), constantStart, value) && constantStart == start;
+    vmWriter.take(start);
+    if (!isConstant) {
+        throw std::runtime_error("Error at line " + std::to_string(tokenizer.getLineNumber()) + ": a constant must be initialized with a constant expression.");
+    }
+    return value;
+}
+
+bool CompilationEngine::isConstantDec() {
+    return options.constants && tokenizer.tokenType() == IDENTIFIER && (tokenizer.currentToken == "const" || tokenizer.currentToken == "enum");
+}
+
 void CompilationEngine::compileSubroutineDec() {
+    markPosition();
     subroutineSymbolTable.reset();
+    labelNumber = 0;
+    profileSite = 0;
+    stringBytes = 0;
     KeyWord functionType = tokenizer.keyWord();
+    currentSubroutineType = functionType;
+    tailCallLabel.clear();
     if (functionType == KW_METHOD) {
         subroutineSymbolTable.define("this", currentClass, ARG);
     }
     writeKeyWord(); // constructor | function | method
     writeType(); // void | type
     std::string subroutineName = currentClass + "." + tokenizer.identifier();
+    currentSubroutine = subroutineName;
     writeIdentifier(); // subroutineName
     writeSymbol(); // '('
     int numParameters = compileParameterList();
@@ -89,21 +263,40 @@ void CompilationEngine::compileSubroutineDec() {
     }
     int nLocalVars = subroutineSymbolTable.varCount(VAR);
     vmWriter.writeFunction(subroutineName, nLocalVars);
+    size_t entry = vmWriter.mark();
     if (functionType == KW_METHOD) {
         vmWriter.writePush("argument", 0);
         vmWriter.writePop("pointer", 0);
     }
     else if (functionType == KW_CONSTRUCTOR) {
-        int nFieldVars = classSymbolTable.varCount(FIELD);
-        vmWriter.writePush("constant", nFieldVars);
-        vmWriter.writeCall("Memory.alloc", 1);
-        vmWriter.writePop("pointer", 0);
+        writeObjectAllocation(classSymbolTable.varCount(FIELD));
+    }
+    if (options.bumpRegion > 0 && subroutineName == "Main.main") {
+        writeBumpRegion();
     }
+    writeCounter("");
     compileStatements();
     if (functionType == KW_CONSTRUCTOR) {
         vmWriter.writePush("pointer", 0);
     }
     writeSymbol(); // }
+    if (functionType == KW_METHOD && !usesThis(entry + 2)) {
+        vmWriter.erase(entry, entry + 2); // the method never touches its object
+    }
+    if (!tailCallLabel.empty()) {
+        vmWriter.insert(entry, {{VM_LABEL, tailCallLabel, 0}});
+    }
+    std::vector<VMCommand> subroutine = vmWriter.take(0);
+    int eliminated = optimizer.eliminateCommonSubexpressions(subroutine);
+    if (options.reportCse) {
+        report << "CSE " << subroutineName << ": eliminated " << eliminated << " VM instructions" << std::endl;
+    }
+    optimizer.packLocals(subroutine);
+    if (options.codeReport) {
+        metrics.push_back(CodeReport::measure(subroutineName, subroutine, stringBytes, classIndex, optimizer));
+    }
+    vmWriter.insert(0, subroutine);
+    vmWriter.flush();
 }
 
 int CompilationEngine::compileParameterList() {
@@ -127,7 +320,7 @@ int CompilationEngine::compileParameterList() {
 }
 
 void CompilationEngine::compileVarDec() {
-    writeKeyWord(); // var
+    writeKeyWord(KW_VAR);
 
     std::string type = tokenizer.type();
     writeType(); // type
@@ -143,6 +336,7 @@ void CompilationEngine::compileVarDec() {
 
 void CompilationEngine::compileStatements() {
     while (isStatement()) {
+        markPosition();
         if (tokenizer.keyWord() == KW_LET) {
             compileLet();
         }
@@ -162,28 +356,46 @@ void CompilationEngine::compileStatements() {
 }
 
 void CompilationEngine::compileLet() {
-    writeKeyWord(); // let
+    writeKeyWord(KW_LET);
     bool isArrayAccess = false;
+    ArrayElement element;
     std::string name = tokenizer.identifier();
     writeIdentifier(); // go forward
     if (!classSymbolTable.exists(name) && !subroutineSymbolTable.exists(name)) {
         throw std::runtime_error("Attempted to assign to an undefined variable.");
     }
+    if (kindOf(name) == CONST) {
+        throw std::runtime_error("Error at line " + std::to_string(tokenizer.getLineNumber()) + ": attempted to assign to the constant " + name + ".");
+    }
     if (tokenizer.tokenType() == SYMBOL && tokenizer.symbol() == '[') {
         isArrayAccess = true;
-        vmWriter.writePush(kindToStr(kindOf(name)), indexOf(name));
-        writeSymbol(); // [
-        compileExpression();
-        writeSymbol(); // ]
-        vmWriter.writeArithmetic("add");
+        element = compileArrayElement(name);
     }
     writeSymbol(); // =
+    size_t valueStart = vmWriter.mark();
+    int reusesBefore = thatReuses;
     compileExpression();
     if (isArrayAccess) {
-        vmWriter.writePop("temp", 0);
-        vmWriter.writePop("pointer", 1);
-        vmWriter.writePush("temp", 0);
-        vmWriter.writePop("that", 0);
+        bool isStillBound = element.isBindable && vmWriter.isThatBound(element.binding)
+            && vmWriter.getThatGeneration() == element.thatGeneration; // not re-bound after its variables changed
+        if (setsThat(valueStart) && !isStillBound) {
+            // the value moved `that`, so keep the element address on the stack instead
+            std::vector<VMCommand> address = element.address;
+            if (!element.isBindable) {
+                // the index may have side effects or labels, so its code is moved, never copied
+                const std::vector<VMCommand>& commands = vmWriter.getCommands();
+                address.assign(commands.begin() + element.setupStart, commands.begin() + element.setupEnd - 1);
+                vmWriter.erase(element.setupStart, element.setupEnd);
+            }
+            else if (thatReuses == reusesBefore) {
+                vmWriter.erase(element.setupStart, element.setupEnd);
+            }
+            vmWriter.insert(element.setupStart, address);
+            vmWriter.writePop("temp", 0);
+            vmWriter.writePop("pointer", 1);
+            vmWriter.writePush("temp", 0);
+        }
+        vmWriter.writePop("that", element.offset);
     }
     else {
         vmWriter.writePop(kindToStr(kindOf(name)), indexOf(name));
@@ -191,57 +403,111 @@ void CompilationEngine::compileLet() {
     writeSymbol(); // ;
 }
 
+// With a profile, the hotter branch is laid out on the fall-through path.
 void CompilationEngine::compileIf() {
-    writeKeyWord(); // if
+    std::string site = "if" + std::to_string(profileSite++);
+    writeKeyWord(KW_IF);
     writeSymbol(); // (
     compileExpression();
     writeSymbol(); // )
     writeSymbol(); // {
-    vmWriter.writeArithmetic("not");
     std::string L1 = "L" + std::to_string(2*labelNumber);
     std::string L2 = "L" + std::to_string(2*labelNumber + 1);
     labelNumber++;
-    vmWriter.writeIf(L1);
-    compileStatements();
-    vmWriter.writeGoTo(L2);
+    bool elseFirst = profileCount(site + ":else") > profileCount(site + ":then");
+    std::vector<VMCommand> thenBranch;
+    if (elseFirst) {
+        vmWriter.writeIf(L1); // L1 starts the then branch, which is moved after the else branch
+        size_t thenStart = vmWriter.mark();
+        vmWriter.writeLabel(L1);
+        writeCounter(site + ":then");
+        compileStatements();
+        thenBranch = vmWriter.take(thenStart);
+        vmWriter.unbindThat(); // the else branch follows the condition, not the then branch
+    }
+    else {
+        vmWriter.writeArithmetic("not");
+        vmWriter.writeIf(L1);
+        writeCounter(site + ":then");
+        compileStatements();
+        vmWriter.writeGoTo(L2);
+        vmWriter.writeLabel(L1);
+    }
     writeSymbol(); // }
-    vmWriter.writeLabel(L1);
+    writeCounter(site + ":else");
     if (tokenizer.tokenType() == KEYWORD && tokenizer.keyWord() == KW_ELSE) {
-        writeKeyWord(); // else
+        writeKeyWord(KW_ELSE);
         writeSymbol(); // {
         compileStatements();
         writeSymbol(); // }
-    }    
+    }
+    if (elseFirst) {
+        vmWriter.writeGoTo(L2);
+        vmWriter.insert(vmWriter.mark(), thenBranch);
+    }
     vmWriter.writeLabel(L2);
 }
 
+// With a profile, loops that iterate are rotated so the condition is tested at the bottom:
+// each iteration then saves the `not` and the jump back to the top.
 void CompilationEngine::compileWhile() {
+    std::string site = "while" + std::to_string(profileSite++);
     std::string L1 = "L" + std::to_string(2*labelNumber);
     std::string L2 = "L" + std::to_string(2*labelNumber + 1);
     labelNumber++;
-    vmWriter.writeLabel(L1);
-    writeKeyWord(); // while
+    writeCounter(site + ":enter");
+    bool rotate = profileCount(site + ":body") > 0;
+    if (rotate) {
+        vmWriter.writeGoTo(L2); // L2 tests the condition, L1 starts the body
+        vmWriter.writeLabel(L1);
+    }
+    else {
+        vmWriter.writeLabel(L1);
+    }
+    size_t conditionStart = vmWriter.mark();
+    writeKeyWord(KW_WHILE);
     writeSymbol(); // (
     compileExpression();
     writeSymbol(); // )
-    vmWriter.writeArithmetic("not");
-    vmWriter.writeIf(L2);
+    std::vector<VMCommand> condition;
+    if (rotate) {
+        condition = vmWriter.take(conditionStart); // the body is only entered right after the condition
+    }
+    else {
+        vmWriter.writeArithmetic("not");
+        vmWriter.writeIf(L2);
+    }
     writeSymbol(); // {
+    writeCounter(site + ":body");
     compileStatements();
-    vmWriter.writeGoTo(L1);
-    vmWriter.writeLabel(L2);
+    if (rotate) {
+        vmWriter.writeLabel(L2);
+        vmWriter.insert(vmWriter.mark(), condition);
+        vmWriter.writeIf(L1);
+    }
+    else {
+        vmWriter.writeGoTo(L1);
+        vmWriter.writeLabel(L2);
+    }
     writeSymbol(); // } 
 }
 
 void CompilationEngine::compileDo() {
-    writeKeyWord(); // do
+    writeKeyWord(KW_DO);
     compileSubroutineCall();
     writeSymbol(); // ;
-    vmWriter.writePop("temp", 0); // pop off returned value    
+    const std::vector<VMCommand>& commands = vmWriter.getCommands();
+    if (commands.back().op == VM_PUSH && commands.back().arg == "constant") {
+        vmWriter.take(commands.size() - 1); // an inlined void routine, nothing was returned
+    }
+    else {
+        vmWriter.writePop("temp", 0); // pop off returned value
+    }
 }
 
 void CompilationEngine::compileReturn() {
     tokenizer.advance(); // return
+    size_t valueStart = vmWriter.mark();
     if (tokenizer.tokenType() != SYMBOL || tokenizer.symbol() != ';') {
         compileExpression();
     }
@@ -249,7 +515,54 @@ void CompilationEngine::compileReturn() {
         vmWriter.writePush("constant", 0);
     }
     writeSymbol(); // ;
-    vmWriter.writeReturn();
+    if (!compileSelfTailCall(valueStart)) {
+        if (options.instrument && currentSubroutine == "Main.main") {
+            vmWriter.writeCall("Profile.dump", 0);
+            vmWriter.writePop("temp", 0);
+        }
+        vmWriter.writeReturn();
+    }
+}
+
+// Attributes the commands written from now on to the current token.
+void CompilationEngine::markPosition() {
+    vmWriter.setPosition({tokenizer.tokenLineNumber() + 1, tokenizer.tokenColumnNumber()});
+}
+
+// Counts executions of `site` in the current subroutine, or of its entry when `site` is empty.
+void CompilationEngine::writeCounter(std::string site) {
+    if (!options.instrument) return;
+    vmWriter.writePush("constant", profiler.counter(site.empty() ? currentSubroutine : currentSubroutine + ":" + site));
+    vmWriter.writeCall("Profile.hit", 1);
+    vmWriter.writePop("temp", 0);
+}
+
+long long CompilationEngine::profileCount(std::string site) {
+    return profiler.count(currentSubroutine + ":" + site);
+}
+
+// Turns `return f(...)`, where f is the subroutine being compiled, into a jump back to its entry:
+// the evaluated arguments replace the current ones and locals are cleared as a fresh call would.
+bool CompilationEngine::compileSelfTailCall(size_t valueStart) {
+    const std::vector<VMCommand>& commands = vmWriter.getCommands();
+    if (currentSubroutineType == KW_CONSTRUCTOR || commands.size() <= valueStart) return false;
+    const VMCommand& last = commands.back();
+    int nArgs = subroutineSymbolTable.varCount(ARG);
+    if (last.op != VM_CALL || last.arg != currentSubroutine || last.index != nArgs) return false;
+
+    vmWriter.take(commands.size() - 1); // call
+    for (int i = nArgs - 1; i >= 0; i--) {
+        vmWriter.writePop("argument", i);
+    }
+    for (int i = 0; i < subroutineSymbolTable.varCount(VAR); i++) {
+        vmWriter.writePush("constant", 0);
+        vmWriter.writePop("local", i);
+    }
+    if (tailCallLabel.empty()) {
+        tailCallLabel = "TAIL_" + currentSubroutine.substr(currentClass.length() + 1);
+    }
+    vmWriter.writeGoTo(tailCallLabel);
+    return true;
 }
 
 void CompilationEngine::compileSubroutineCall() {
@@ -266,75 +579,144 @@ void CompilationEngine::compileSubroutineCall() {
 }
 
 void CompilationEngine::compileExpression() {
-    compileTerm();
-    while (tokenizer.tokenType() == SYMBOL && isOp()) {
-        std::string op = binaryOp();
-        writeSymbol();
-        compileTerm();
-        vmWriter.writeArithmetic(op);
-    }
+    compileOperands();
 }
 
-void CompilationEngine::compileTerm() {
-    TokenType tt = tokenizer.tokenType();
-    if (tt == INT_CONST) {
-        writeIntConst();
-    }
-    else if (tt == STRING_CONST) {
-        writeStrConst();
-    }
-    else if (isKeyWordConstant()) {
-        writeKeyWordConst();
-    }
-    else if (tt == IDENTIFIER) {
-        std::string name = tokenizer.identifier();
-        tokenizer.advance();
-        // subroutineName(expressionList)
-        if (tokenizer.tokenType() == SYMBOL && tokenizer.symbol() == '(') {
-            compileCurrentObjectSubroutineCall(name);
+// Compiles an expression, keeping enclosing parentheses, array indices and argument lists on an
+// explicit stack instead of recursing, so nesting depth only costs heap memory.
+// Operators are applied strictly left to right as Jack requires.
+void CompilationEngine::compileOperands() {
+    std::vector<ExpressionFrame> frames(1);
+    frames.back().context = EXPR_TOP;
+    bool isTermDone = false;
+    while (true) {
+        if (!isTermDone) {
+            markPosition();
+            // unaryOp term
+            while (tokenizer.tokenType() == SYMBOL && (tokenizer.symbol() == '-' || tokenizer.symbol() == '~')) {
+                frames.back().unaryOps.push_back(unaryOp());
+                writeSymbol(); // op
+            }
+            TokenType tt = tokenizer.tokenType();
+            if (tt == SYMBOL && tokenizer.symbol() == '(') {
+                // (expression)
+                writeSymbol(); // (
+                frames.emplace_back();
+                frames.back().context = EXPR_PARENS;
+                continue;
+            }
+            isTermDone = true;
+            if (tt == INT_CONST) {
+                writeIntConst();
+            }
+            else if (tt == STRING_CONST) {
+                writeStrConst();
+            }
+            else if (isKeyWordConstant()) {
+                writeKeyWordConst();
+            }
+            else if (tt == IDENTIFIER) {
+                std::string name = tokenizer.identifier();
+                tokenizer.advance();
+                bool isCall = tokenizer.tokenType() == SYMBOL && (tokenizer.symbol() == '(' || tokenizer.symbol() == '.');
+                if (isCall) {
+                    // subroutineName(expressionList) | (className|varName).subroutineName(expressionList)
+                    SubroutineCall call = tokenizer.symbol() == '(' ? beginCurrentObjectSubroutineCall(name) : beginClassVarSubroutineCall(name);
+                    if (tokenizer.tokenType() == SYMBOL && tokenizer.symbol() == ')') {
+                        finishSubroutineCall(call, 0);
+                        continue;
+                    }
+                    frames.emplace_back();
+                    frames.back().context = EXPR_ARGUMENTS;
+                    frames.back().call = call;
+                    isTermDone = false;
+                }
+                else if (tokenizer.tokenType() == SYMBOL && tokenizer.symbol() == '[') {
+                    // varName[expression]
+                    ArrayElement element = beginArrayElement(name);
+                    frames.emplace_back();
+                    frames.back().context = EXPR_INDEX;
+                    frames.back().element = element;
+                    isTermDone = false;
+                }
+                else if (kindOf(name) == CONST) {
+                    writeConstant(indexOf(name));
+                }
+                else {
+                    vmWriter.writePush(kindToStr(kindOf(name)), indexOf(name));
+                }
+            }
+            continue;
         }
-        // (className|varName).subroutineName(expressionList)
-        else if (tokenizer.tokenType() == SYMBOL && tokenizer.symbol() == '.') {
-            compileClassVarSubroutineCall(name);
+
+        ExpressionFrame& frame = frames.back();
+        while (!frame.unaryOps.empty()) {
+            writeUnaryOp(frame.unaryOps.back());
+            frame.unaryOps.pop_back();
         }
-        // varName[expression]
-        else if (tokenizer.tokenType() == SYMBOL && tokenizer.symbol() == '[') {
-            vmWriter.writePush(kindToStr(kindOf(name)), indexOf(name));
-            writeSymbol(); // [
-            compileExpression(); 
-            writeSymbol(); // ]
-            vmWriter.writeArithmetic("add");
-            vmWriter.writePop("pointer", 1);
-            vmWriter.writePush("that", 0);
+        if (!frame.pendingOp.empty()) {
+            writeBinaryOp(frame.pendingOp);
+            frame.pendingOp.clear();
         }
-        else {
-            vmWriter.writePush(kindToStr(kindOf(name)), indexOf(name));
+        if (tokenizer.tokenType() == SYMBOL && isOp()) {
+            frame.pendingOp = binaryOp();
+            writeSymbol(); // op
+            isTermDone = false;
+            continue;
+        }
+
+        // the frame's expression is complete, and with it the enclosing term
+        if (frame.context == EXPR_TOP) {
+            return;
+        }
+        else if (frame.context == EXPR_PARENS) {
+            writeSymbol(); // )
+            frames.pop_back();
+        }
+        else if (frame.context == EXPR_INDEX) {
+            ArrayElement element = frame.element;
+            frames.pop_back();
+            finishArrayElement(element);
+            vmWriter.writePush("that", element.offset);
+        }
+        else if (frame.context == EXPR_ARGUMENTS) {
+            frame.nArgs++;
+            if (tokenizer.tokenType() == SYMBOL && tokenizer.symbol() == ',') {
+                tokenizer.advance(); // ,
+                isTermDone = false;
+                continue;
+            }
+            SubroutineCall call = frame.call;
+            int nArgs = frame.nArgs;
+            frames.pop_back();
+            finishSubroutineCall(call, nArgs);
         }
-    }
-    else if (tt == SYMBOL && tokenizer.symbol() == '(') {
-        // (expression)
-        writeSymbol(); // (
-        compileExpression();
-        writeSymbol(); // )
-    }
-    else if (tt == SYMBOL && (tokenizer.symbol() == '-' || tokenizer.symbol() == '~')) {
-        // unaryOp term
-        std::string op = unaryOp();
-        writeSymbol(); // op
-        compileTerm();
-        vmWriter.writeArithmetic(op);
     }
 }
 
 void CompilationEngine::compileCurrentObjectSubroutineCall(std::string name) {
-    vmWriter.writePush("pointer", 0);
-    writeSymbol(); // (
+    SubroutineCall call = beginCurrentObjectSubroutineCall(name);
     int numExpressions = compileExpressionList();
-    writeSymbol(); // )
-    vmWriter.writeCall(currentClass + "." + name, numExpressions + 1);
+    finishSubroutineCall(call, numExpressions);
 }
 
 void CompilationEngine::compileClassVarSubroutineCall(std::string name) {
+    SubroutineCall call = beginClassVarSubroutineCall(name);
+    int numExpressions = compileExpressionList();
+    finishSubroutineCall(call, numExpressions);
+}
+
+SubroutineCall CompilationEngine::beginCurrentObjectSubroutineCall(std::string name) {
+    const SubroutineSignature* callee = classIndex.find(currentClass, name);
+    bool isStatic = callee && callee->kind != KW_METHOD; // functions and constructors take no object
+    if (!isStatic) {
+        vmWriter.writePush("pointer", 0);
+    }
+    writeSymbol(); // (
+    return {currentClass + "." + name, isStatic};
+}
+
+SubroutineCall CompilationEngine::beginClassVarSubroutineCall(std::string name) {
     bool isStatic = !(classSymbolTable.exists(name) || subroutineSymbolTable.exists(name)); // is this a call to static function?
     std::string functionName;
     if (!isStatic) {
@@ -348,9 +730,318 @@ void CompilationEngine::compileClassVarSubroutineCall(std::string name) {
     functionName += "." + tokenizer.identifier();
     tokenizer.advance(); // subroutineName
     writeSymbol(); // (
-    int numExpressions = compileExpressionList();
+    return {functionName, isStatic};
+}
+
+void CompilationEngine::finishSubroutineCall(const SubroutineCall& call, int numExpressions) {
     writeSymbol(); // )
-    vmWriter.writeCall(functionName, isStatic ? numExpressions : numExpressions + 1); // if not static, 'this' is an extra arg
+    checkSubroutineCall(call, numExpressions);
+    if (writeObjectRelease(call, numExpressions)) {
+        return;
+    }
+    int nArgs = call.isStatic ? numExpressions : numExpressions + 1; // if not static, 'this' is an extra arg
+    // the intrinsics are functions, except Array.dispose, usually called as `a.dispose()`
+    bool isIntrinsicForm = call.isStatic || call.functionName == "Array.dispose";
+    if (isIntrinsicForm && options.useIntrinsics && writeIntrinsic(call.functionName, nArgs)) {
+        return;
+    }
+    vmWriter.writeCall(call.functionName, nArgs);
+}
+
+// Reports calls that do not match the callee's signature in the class index. Classes outside
+// the project, such as the OS, are not checked.
+void CompilationEngine::checkSubroutineCall(const SubroutineCall& call, int numExpressions) {
+    const SubroutineSignature* callee = classIndex.find(call.functionName);
+    if (!callee) return;
+    if (callee->nParameters != numExpressions) {
+        std::cerr << "Error at line " << tokenizer.getLineNumber() << ": " << call.functionName << " expects " << callee->nParameters << " arguments but got " << numExpressions << std::endl;
+    }
+    if (callee->kind == KW_METHOD && call.isStatic) {
+        std::cerr << "Error at line " << tokenizer.getLineNumber() << ": method " << call.functionName << " was called without an object" << std::endl;
+    }
+    else if (callee->kind != KW_METHOD && !call.isStatic) {
+        std::cerr << "Error at line " << tokenizer.getLineNumber() << ": " << call.functionName << " is not a method but was called on an object" << std::endl;
+    }
+}
+
+// Replaces a call to a well-known OS routine, whose arguments are already on the stack, with
+// an equivalent inline sequence. Returns false when the routine has no inline form.
+bool CompilationEngine::writeIntrinsic(std::string functionName, int nArgs) {
+    enum Intrinsic { PEEK, POKE, ABS, MIN, MAX, ARRAY_NEW, ARRAY_DISPOSE };
+    static const std::unordered_map<std::string, std::pair<Intrinsic, int>> intrinsics = {
+        {"Memory.peek", {PEEK, 1}},
+        {"Memory.poke", {POKE, 2}},
+        {"Math.abs", {ABS, 1}},
+        {"Math.min", {MIN, 2}},
+        {"Math.max", {MAX, 2}},
+        {"Array.new", {ARRAY_NEW, 1}},
+        {"Array.dispose", {ARRAY_DISPOSE, 1}}
+    };
+    auto intrinsic = intrinsics.find(functionName);
+    if (intrinsic == intrinsics.end() || intrinsic->second.second != nArgs) return false;
+
+    const std::vector<VMCommand>& commands = vmWriter.getCommands();
+    std::string L1 = "L" + std::to_string(2*labelNumber);
+    std::string L2 = "L" + std::to_string(2*labelNumber + 1);
+    switch (intrinsic->second.first) {
+        case PEEK:
+            vmWriter.writePop("pointer", 1);
+            vmWriter.writePush("that", 0);
+            break;
+        case POKE: {
+            const VMCommand value = commands.back();
+            if (value.op == VM_PUSH && value.arg != "that" && value.arg != "pointer") {
+                // a single push can be moved after the address is taken
+                vmWriter.take(commands.size() - 1);
+                vmWriter.writePop("pointer", 1);
+                vmWriter.writePush(value.arg, value.index);
+            }
+            else {
+                vmWriter.writePop("temp", 0);
+                vmWriter.writePop("pointer", 1);
+                vmWriter.writePush("temp", 0);
+            }
+            vmWriter.writePop("that", 0);
+            vmWriter.writePush("constant", 0);
+            break;
+        }
+        case ABS:
+            labelNumber++;
+            vmWriter.writePop("temp", 0);
+            vmWriter.writePush("temp", 0);
+            vmWriter.writePush("temp", 0);
+            vmWriter.writePush("constant", 0);
+            vmWriter.writeArithmetic("lt");
+            vmWriter.writeArithmetic("not");
+            vmWriter.writeIf(L1);
+            vmWriter.writeArithmetic("neg");
+            vmWriter.writeLabel(L1);
+            break;
+        case MIN:
+        case MAX:
+            labelNumber++;
+            vmWriter.writePop("temp", 1);
+            vmWriter.writePop("temp", 0);
+            vmWriter.writePush("temp", 0);
+            vmWriter.writePush("temp", 1);
+            vmWriter.writeArithmetic(intrinsic->second.first == MIN ? "gt" : "lt");
+            vmWriter.writeIf(L1);
+            vmWriter.writePush("temp", 0);
+            vmWriter.writeGoTo(L2);
+            vmWriter.writeLabel(L1);
+            vmWriter.writePush("temp", 1);
+            vmWriter.writeLabel(L2);
+            break;
+        case ARRAY_NEW:
+            vmWriter.writeCall("Memory.alloc", 1);
+            break;
+        case ARRAY_DISPOSE:
+            vmWriter.writeCall("Memory.deAlloc", 1);
+            break;
+    }
+    return true;
+}
+
+// --bump-alloc: objects are carved out of a region whose next free word is kept in temp 6 and
+// whose end is kept in temp 7. No other code compiled with the option uses these temps, so
+// they keep their values across calls. Main.main reserves the region with Memory.alloc; until
+// then both are 0 and constructors fall back to Memory.alloc. Objects from the region have no
+// Memory.alloc header and must not reach Memory.deAlloc: classes with a method that calls
+// `Memory.deAlloc(this)` keep the objects it releases on a free list of their own instead, and
+// other classes drop region objects and pass the rest to Memory.deAlloc.
+void CompilationEngine::writeBumpRegion() {
+    vmWriter.writePush("constant", options.bumpRegion);
+    vmWriter.writeCall("Memory.alloc", 1);
+    vmWriter.writePop("temp", 6);
+    vmWriter.writePush("temp", 6);
+    vmWriter.writePush("constant", options.bumpRegion);
+    vmWriter.writeArithmetic("add");
+    vmWriter.writePop("temp", 7);
+}
+
+// Points `this` at a new object of `nFields` words: the head of the class's free list, else
+// the next words of the region, else a block from Memory.alloc.
+void CompilationEngine::writeObjectAllocation(int nFields) {
+    if (options.bumpRegion == 0 || nFields == 0) {
+        vmWriter.writePush("constant", nFields);
+        vmWriter.writeCall("Memory.alloc", 1);
+        vmWriter.writePop("pointer", 0);
+        return;
+    }
+    std::string slowPath = "L" + std::to_string(2*labelNumber);
+    std::string done = "L" + std::to_string(2*labelNumber + 1);
+    std::string reuse = "L" + std::to_string(2*labelNumber + 2);
+    labelNumber += 2;
+    int freeList = classSymbolTable.varCount(STATIC); // hidden, after the declared statics
+    if (hasFreeList()) {
+        vmWriter.writePush("static", freeList);
+        vmWriter.writeIf(reuse);
+    }
+    vmWriter.writePush("temp", 6);
+    vmWriter.writePush("constant", nFields);
+    vmWriter.writeArithmetic("add");
+    vmWriter.writePush("temp", 7);
+    vmWriter.writeArithmetic("gt");
+    vmWriter.writeIf(slowPath);
+    vmWriter.writePush("temp", 6);
+    vmWriter.writePop("pointer", 0);
+    vmWriter.writePush("pointer", 0);
+    vmWriter.writePush("constant", nFields);
+    vmWriter.writeArithmetic("add");
+    vmWriter.writePop("temp", 6);
+    vmWriter.writeGoTo(done);
+    vmWriter.writeLabel(slowPath);
+    vmWriter.writePush("constant", nFields);
+    vmWriter.writeCall("Memory.alloc", 1);
+    vmWriter.writePop("pointer", 0);
+    if (hasFreeList()) {
+        vmWriter.writeGoTo(done);
+        vmWriter.writeLabel(reuse);
+        vmWriter.writePush("static", freeList);
+        vmWriter.writePop("pointer", 0);
+        vmWriter.writePush("this", 0); // the next free object
+        vmWriter.writePop("static", freeList);
+    }
+    vmWriter.writeLabel(done);
+}
+
+// Compiles `Memory.deAlloc(this)`, whose argument is already on the stack, for --bump-alloc.
+// Returns false for any other call.
+bool CompilationEngine::writeObjectRelease(const SubroutineCall& call, int numExpressions) {
+    if (options.bumpRegion == 0 || !call.isStatic || call.functionName != "Memory.deAlloc" || numExpressions != 1) return false;
+    const std::vector<VMCommand>& commands = vmWriter.getCommands();
+    const VMCommand& argument = commands.back();
+    if (currentSubroutineType != KW_METHOD || argument.op != VM_PUSH || argument.arg != "pointer" || argument.index != 0) return false;
+    if (classSymbolTable.varCount(FIELD) == 0) return false; // allocated by Memory.alloc
+    vmWriter.take(commands.size() - 1);
+    if (!hasFreeList()) {
+        writeRegionRelease();
+        return true;
+    }
+    int freeList = classSymbolTable.varCount(STATIC);
+    vmWriter.writePush("static", freeList);
+    vmWriter.writePop("this", 0);
+    vmWriter.writePush("pointer", 0);
+    vmWriter.writePop("static", freeList);
+    vmWriter.writePush("constant", 0); // the return value of Memory.deAlloc
+    return true;
+}
+
+// Releases `this` in a class without a free list, which only happens when the class index could
+// not read the class: an object that came from Memory.alloc, once the region ran out, goes back
+// to it, and one from the region is dropped.
+// The region is the bumpRegion words that end at temp 7.
+void CompilationEngine::writeRegionRelease() {
+    std::string heapObject = "L" + std::to_string(2*labelNumber);
+    std::string done = "L" + std::to_string(2*labelNumber + 1);
+    labelNumber++;
+    vmWriter.writePush("pointer", 0);
+    vmWriter.writePush("temp", 7);
+    vmWriter.writeArithmetic("lt");
+    vmWriter.writePush("pointer", 0);
+    vmWriter.writePush("temp", 7);
+    vmWriter.writePush("constant", options.bumpRegion);
+    vmWriter.writeArithmetic("sub");
+    vmWriter.writeArithmetic("lt");
+    vmWriter.writeArithmetic("not");
+    vmWriter.writeArithmetic("and");
+    vmWriter.writeArithmetic("not");
+    vmWriter.writeIf(heapObject);
+    vmWriter.writePush("constant", 0); // the return value of Memory.deAlloc
+    vmWriter.writeGoTo(done);
+    vmWriter.writeLabel(heapObject);
+    vmWriter.writePush("pointer", 0);
+    vmWriter.writeCall("Memory.deAlloc", 1);
+    vmWriter.writeLabel(done);
+}
+
+// Whether constructors of the current class reuse the objects its methods release.
+bool CompilationEngine::hasFreeList() {
+    const ClassSignature* signature = classIndex.findClass(currentClass);
+    return signature && signature->releasesThis;
+}
+
+// Compiles '[' expression ']' after the array variable `name` and points `that` at the element.
+ArrayElement CompilationEngine::compileArrayElement(std::string name) {
+    ArrayElement element = beginArrayElement(name);
+    compileExpression();
+    finishArrayElement(element);
+    return element;
+}
+
+ArrayElement CompilationEngine::beginArrayElement(std::string name) {
+    ArrayElement element;
+    element.setupStart = vmWriter.mark();
+    element.offset = 0;
+    element.binding = {kindToStr(kindOf(name)), indexOf(name), "", 0};
+    vmWriter.writePush(element.binding.baseSegment, element.binding.baseIndex);
+    writeSymbol(); // [
+    element.indexStart = vmWriter.mark();
+    return element;
+}
+
+// Sets `pointer 1` once the index has been compiled. Constant indices become a `that` offset, and
+// an unchanged `that` pointer from an earlier access to the same element is reused.
+void CompilationEngine::finishArrayElement(ArrayElement& element) {
+    writeSymbol(); // ]
+    const std::vector<VMCommand>& commands = vmWriter.getCommands();
+    bool isSingle = commands.size() - element.indexStart == 1 && commands.back().op == VM_PUSH;
+    bool isConstant = isSingle && commands.back().arg == "constant";
+    bool isVariable = isSingle && (commands.back().arg == "local" || commands.back().arg == "argument"
+        || commands.back().arg == "static" || commands.back().arg == "this");
+    element.isBindable = isConstant || isVariable;
+    if (!element.isBindable) {
+        vmWriter.writeArithmetic("add");
+        vmWriter.writePop("pointer", 1);
+        element.setupEnd = vmWriter.mark();
+        return;
+    }
+
+    std::vector<VMCommand> index = vmWriter.take(element.indexStart);
+    element.address = vmWriter.take(element.setupStart);
+    if (isConstant) {
+        element.offset = index[0].index;
+    }
+    else {
+        element.binding.indexSegment = index[0].arg;
+        element.binding.indexIndex = index[0].index;
+        element.address.push_back(index[0]);
+        element.address.push_back({VM_ARITHMETIC, "add", 0});
+    }
+
+    if (vmWriter.isThatBound(element.binding)) {
+        thatReuses++;
+    }
+    else {
+        vmWriter.insert(element.setupStart, element.address);
+        vmWriter.writePop("pointer", 1);
+        vmWriter.bindThat(element.binding);
+    }
+    element.thatGeneration = vmWriter.getThatGeneration();
+    element.setupEnd = vmWriter.mark();
+}
+
+// Whether any command emitted since `from` moves the `that` pointer.
+bool CompilationEngine::setsThat(size_t from) {
+    const std::vector<VMCommand>& commands = vmWriter.getCommands();
+    for (size_t i = from; i < commands.size(); i++) {
+        if (commands[i].op == VM_POP && commands[i].arg == "pointer" && commands[i].index == 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether any command emitted since `from` reads or writes the current object.
+bool CompilationEngine::usesThis(size_t from) {
+    const std::vector<VMCommand>& commands = vmWriter.getCommands();
+    for (size_t i = from; i < commands.size(); i++) {
+        if ((commands[i].op == VM_PUSH || commands[i].op == VM_POP)
+            && (commands[i].arg == "this" || (commands[i].arg == "pointer" && commands[i].index == 0))) {
+            return true;
+        }
+    }
+    return false;
 }
 
 int CompilationEngine::compileExpressionList() {
@@ -374,6 +1065,13 @@ void CompilationEngine::writeKeyWord() {
     tokenizer.advance();
 }
 
+void CompilationEngine::writeKeyWord(KeyWord expected) {
+    if (tokenizer.tokenType() != KEYWORD || tokenizer.keyWord() != expected) {
+        std::cerr << "Error at line " << tokenizer.getLineNumber() << ": expected " << keyWordName(expected) << " but got " << tokenizer.currentToken << std::endl;
+    }
+    tokenizer.advance();
+}
+
 void CompilationEngine::writeType() {
     if (tokenizer.tokenType() != KEYWORD && tokenizer.tokenType() != IDENTIFIER) {
         std::cerr << "Error at line " << tokenizer.getLineNumber() << ": expected type but got " << tokenizer.currentToken << std::endl;
@@ -409,6 +1107,7 @@ void CompilationEngine::writeStrConst() {
         std::cerr << "Error at line " << tokenizer.getLineNumber() << ": expected STR_CONST but got " << tokenizer.currentToken << std::endl;
     }
     std::string str = tokenizer.stringVal();
+    stringBytes += str.length();
     vmWriter.writePush("constant", str.length());
     vmWriter.writeCall("String.new", 1);
     for (int i = 0; i < str.length(); i++) {
@@ -425,6 +1124,7 @@ std::string CompilationEngine::kindToStr(Kind kind) {
         case FIELD: return "this";
         case ARG: return "argument";
         case VAR: return "local";
+        case CONST: return "constant";
         case NONE: return "-1";
         default: return "-1";
     }
@@ -473,31 +1173,111 @@ bool CompilationEngine::isKeyWordConstant() {
 }
 
 bool CompilationEngine::isOp() {
-    static const std::vector<char> ops = {'+', '-', '*', '/', '&', '|', '<', '>', '='};
-    return (std::find(ops.begin(), ops.end(), tokenizer.symbol()) != ops.end());
+    return !binaryOpTable()[static_cast<unsigned char>(tokenizer.symbol())].empty();
 }
 
-bool CompilationEngine::isUnaryOp() {
-    return (isOp() && (tokenizer.symbol() == '-' || tokenizer.symbol() == '~')); 
+// VM command for each binary operator character, empty for every other character.
+const std::array<std::string, 256>& CompilationEngine::binaryOpTable() {
+    static const std::array<std::string, 256> table = [] {
+        std::array<std::string, 256> ops;
+        ops['+'] = "add";
+        ops['-'] = "sub";
+        ops['*'] = "Math.multiply";
+        ops['/'] = "Math.divide";
+        ops['&'] = "and";
+        ops['|'] = "or";
+        ops['<'] = "lt";
+        ops['>'] = "gt";
+        ops['='] = "eq";
+        return ops;
+    }();
+    return table;
 }
 
 std::string CompilationEngine::binaryOp() {
-    if (tokenizer.tokenType() != SYMBOL) {
+    if (tokenizer.tokenType() != SYMBOL || !isOp()) {
         std::cerr << "Error at line " << tokenizer.getLineNumber() << ": expected binary operator but got " << tokenizer.currentToken << std::endl;
+        return "";
     }
-    switch (tokenizer.symbol()) {
-        case '+': return "add";
-        case '-': return "sub";
-        case '*': return "call Math.multiply 2";
-        case '/': return "call Math.divide 2";
-        case '&': return "and";
-        case '|': return "or";
-        case '<': return "lt";
-        case '>': return "gt";
-        case '=': return "eq";
-        default : std::cerr << "Error at line " << tokenizer.getLineNumber() << ": expected binary operator but got " << tokenizer.currentToken << std::endl;
+    return binaryOpTable()[static_cast<unsigned char>(tokenizer.symbol())];
+}
+
+// Operators whose operands are both constants are folded, with the 16-bit wraparound of the Hack
+// platform; comparisons give -1 for true. Division by zero is left to Math.divide to report.
+void CompilationEngine::writeBinaryOp(std::string op) {
+    size_t rightStart, leftStart;
+    int right, left;
+    if (trailingConstant(vmWriter.mark(), rightStart, right) && trailingConstant(rightStart, leftStart, left)
+        && !(op == "Math.divide" && right == 0)) {
+        int value = 0;
+        if (op == "add") value = left + right;
+        else if (op == "sub") value = left - right;
+        else if (op == "Math.multiply") value = left * right;
+        else if (op == "Math.divide") value = left / right;
+        else if (op == "and") value = left & right;
+        else if (op == "or") value = left | right;
+        else if (op == "lt") value = left < right ? -1 : 0;
+        else if (op == "gt") value = left > right ? -1 : 0;
+        else if (op == "eq") value = left == right ? -1 : 0;
+        vmWriter.take(leftStart);
+        writeConstant(value);
+        return;
+    }
+    if (op == "Math.multiply" || op == "Math.divide") {
+        vmWriter.writeCall(op, 2);
+    }
+    else {
+        vmWriter.writeArithmetic(op);
+    }
+}
+
+void CompilationEngine::writeUnaryOp(std::string op) {
+    size_t start;
+    int value;
+    if (trailingConstant(vmWriter.mark(), start, value)) {
+        vmWriter.take(start);
+        writeConstant(op == "neg" ? -value : ~value);
+        return;
+    }
+    vmWriter.writeArithmetic(op);
+}
+
+// `push constant` only takes 0..32767: other values are built with `neg`, and -32768 with `not`.
+void CompilationEngine::writeConstant(int value) {
+    value = static_cast<int16_t>(value);
+    if (value >= 0) {
+        vmWriter.writePush("constant", value);
+    }
+    else if (value == -32768) {
+        vmWriter.writePush("constant", 32767);
+        vmWriter.writeArithmetic("not");
+    }
+    else {
+        vmWriter.writePush("constant", -value);
+        vmWriter.writeArithmetic("neg");
     }
-    return "";
+}
+
+// Finds the constant computed by the commands just before `end`, as written by writeConstant()
+// or for `true`. Returns false if they compute anything else.
+bool CompilationEngine::trailingConstant(size_t end, size_t& start, int& value) {
+    const std::vector<VMCommand>& commands = vmWriter.getCommands();
+    if (end == 0) return false;
+    const VMCommand& last = commands[end - 1];
+    if (last.op == VM_PUSH && last.arg == "constant") {
+        start = end - 1;
+        value = last.index;
+        return true;
+    }
+    if (end >= 2 && last.op == VM_ARITHMETIC && (last.arg == "neg" || last.arg == "not")) {
+        const VMCommand& push = commands[end - 2];
+        if (push.op == VM_PUSH && push.arg == "constant") {
+            start = end - 2;
+            value = last.arg == "neg" ? -push.index : ~push.index;
+            return true;
+        }
+    }
+    return false;
 }
 
 std::string CompilationEngine::unaryOp() {
@@ -512,11 +1292,6 @@ std::string CompilationEngine::unaryOp() {
     return "";
 }
 
-bool CompilationEngine::isTerm() {
-    TokenType tt = tokenizer.tokenType();
-    return (tt == INT_CONST || tt == STRING_CONST || isKeyWordConstant() || tt == IDENTIFIER || isUnaryOp());
-}
-
 Kind CompilationEngine::kindOf(std::string name) {
     if (subroutineSymbolTable.exists(name)) {
         return subroutineSymbolTable.kindOf(name);
@@ -2,18 +2,66 @@
 
 #include <filesystem>
 #include <fstream>
+#include <sstream>
+#include <vector>
+#include <array>
 #include "JackTokenizer.hpp"
 #include "Enums.hpp"
 #include "SymbolTable.hpp"
 #include "VMWriter.hpp"
+#include "Optimizer.hpp"
+#include "CodeReport.hpp"
+#include "CompilerOptions.hpp"
+#include "ClassIndex.hpp"
+#include "Profiler.hpp"
+
+// An array element whose address has been loaded into `pointer 1`.
+struct ArrayElement {
+    std::vector<VMCommand> address; // pushes the address of `that 0`
+    int offset;                     // the element is `that offset`
+    size_t setupStart;              // buffered commands that set `pointer 1`
+    size_t indexStart;
+    size_t setupEnd;
+    bool isBindable;                // base and index are plain variables or constants
+    ThatBinding binding;
+    int thatGeneration;             // of the binding once `pointer 1` was set
+};
+
+// A subroutine call whose argument list is being compiled.
+struct SubroutineCall {
+    std::string functionName;
+    bool isStatic; // no object was pushed as an extra first argument
+};
+
+enum ExpressionContext {
+    EXPR_TOP,
+    EXPR_PARENS,
+    EXPR_INDEX,
+    EXPR_ARGUMENTS
+};
+
+// One level of the explicit stack used to compile nested expressions.
+struct ExpressionFrame {
+    ExpressionContext context;
+    std::vector<std::string> unaryOps; // applied, innermost first, once the current term is complete
+    std::string pendingOp;             // binary operator waiting for the current term
+    ArrayElement element;              // EXPR_INDEX: the array being indexed
+    SubroutineCall call;               // EXPR_ARGUMENTS: the call being compiled
+    int nArgs = 0;                     // EXPR_ARGUMENTS: arguments compiled so far
+};
 
 class CompilationEngine {
 public:
-    // Takes path to single .jack file, and one path to .vm file to write translated code
-    CompilationEngine(std::filesystem::path inputPath, std::filesystem::path outputPath);
+    // Compiles the class in `inputPath` into memory, see output().
+    CompilationEngine(std::filesystem::path inputPath, const ClassIndex& classIndex, Profiler& profiler, CompilerOptions options);
+    // The same, with the contents of `inputPath` already read.
+    CompilationEngine(std::filesystem::path inputPath, std::string source, const ClassIndex& classIndex, Profiler& profiler, CompilerOptions options);
+    // Compiles one subroutine of `className` from a slice of its source into memory.
+    CompilationEngine(std::string source, int firstLine, int firstColumn, std::string className, const SymbolTable& classSymbolTable, const ClassIndex& classIndex, Profiler& profiler, CompilerOptions options);
 
     void compileClass();
     void compileClassVarDec();
+    void compileConstantDec();
     void compileSubroutineDec();
     int compileParameterList();
     void compileSubroutineBody();
@@ -26,20 +74,40 @@ public:
     void compileReturn();
     void compileSubroutineCall();
     void compileExpression();
-    void compileTerm();
     int compileExpressionList();
+    std::string output();
+    LineMap& getLineMap();
+    const std::vector<SubroutineMetrics>& getMetrics();
 
 private:
     JackTokenizer tokenizer;
     SymbolTable classSymbolTable;
     SymbolTable subroutineSymbolTable;
-    VMWriter vmWriter;
-    std::ifstream inputStream;
+    VMWriter<MemorySink> vmWriter;
+    Optimizer optimizer;
+    const ClassIndex& classIndex;
+    Profiler& profiler;
+    CompilerOptions options;
+    std::ostringstream report; // --cse-report lines, printed once the class is compiled
+    std::vector<SubroutineMetrics> metrics; // --code-report measurements
 
-    int labelNumber; // for unique labels in IF, WHILE
+    int labelNumber; // for labels in IF, WHILE; restarts at every subroutine
+    int profileSite; // numbers the IF and WHILE statements of the subroutine for profile counters
+    int stringBytes; // characters of the string constants compiled in the subroutine
+    int thatReuses; // array accesses that reused an already-set `that` pointer
+    std::string sourceName; // file name of the class being compiled
     std::string currentClass;
+    std::string currentSubroutine; // ClassName.subroutineName
+    KeyWord currentSubroutineType;
+    std::string tailCallLabel; // entry point for self tail calls, empty until one is compiled
 
+    void initialize();
+    void compileSubroutineSlices();
+    void markPosition();
+    void writeCounter(std::string site);
+    long long profileCount(std::string site);
     void writeKeyWord();
+    void writeKeyWord(KeyWord expected);
     void writeSymbol();
     void writeIntConst();
     void writeStrConst();
@@ -48,18 +116,39 @@ private:
     void writeKeyWordConst();
     void compileCurrentObjectSubroutineCall(std::string name);
     void compileClassVarSubroutineCall(std::string name);
+    bool writeIntrinsic(std::string functionName, int nArgs);
+    void writeBumpRegion();
+    void writeObjectAllocation(int nFields);
+    bool writeObjectRelease(const SubroutineCall& call, int numExpressions);
+    void writeRegionRelease();
+    bool hasFreeList();
+    void compileOperands();
+    SubroutineCall beginCurrentObjectSubroutineCall(std::string name);
+    SubroutineCall beginClassVarSubroutineCall(std::string name);
+    void finishSubroutineCall(const SubroutineCall& call, int numExpressions);
+    void checkSubroutineCall(const SubroutineCall& call, int numExpressions);
+    ArrayElement compileArrayElement(std::string name);
+    ArrayElement beginArrayElement(std::string name);
+    void finishArrayElement(ArrayElement& element);
+    bool setsThat(size_t from);
+    bool usesThis(size_t from);
+    bool compileSelfTailCall(size_t valueStart);
     bool isType();
     bool isStatement();
-    bool isTerm();
     bool isKeyWordConstant();
     bool isOp();
-    bool isUnaryOp();
     std::string binaryOp();
+    void writeBinaryOp(std::string op);
+    void writeUnaryOp(std::string op);
+    void writeConstant(int value);
+    bool trailingConstant(size_t end, size_t& start, int& value);
+    int evaluateConstant();
+    bool isConstantDec();
+    static const std::array<std::string, 256>& binaryOpTable();
     std::string unaryOp();
     std::string kindToStr(Kind kind);
     Kind kindOf(std::string name);
     int indexOf(std::string name);
     std::string typeOf(std::string name);
 
-    std::unordered_map<KeyWord, std::string> keyWordToStr;
 };
\ No newline at end of file
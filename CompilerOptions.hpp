@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+// Switches from the command line, shared by the analyzer and every compilation engine.
+struct CompilerOptions {
+    bool useIntrinsics = true; // inline well-known OS routines; off when linking a non-standard OS
+    bool reportCse = false;    // print the instructions removed by common subexpression elimination
+    int jobs = 1;              // threads compiling the subroutines of one class
+    bool instrument = false;   // count subroutine entries and branches through the generated Profile class
+    std::string profilePath;   // output of an instrumented run, used to lay out hot code
+    bool constants = false;    // accept class-level `const` and `enum` declarations (language extension)
+    bool lineMap = false;      // write a .vm.map line table next to every output
+    bool codeReport = false;   // write the size of every generated subroutine to CodeReport.json/.txt
+    int bumpRegion = 0;        // words of the inline constructor allocation region, 0 to always call Memory.alloc
+    std::string bundlePath;    // write every class into this one .vm file, ordered by the call graph
+};
\ No newline at end of file
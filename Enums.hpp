@@ -40,5 +40,18 @@ enum Kind {
     FIELD,
     ARG,
     VAR,
+    CONST, // class-level constant or enum member; its symbol table index is its value
     NONE
+};
+
+enum VMOp {
+    VM_PUSH,
+    VM_POP,
+    VM_ARITHMETIC,
+    VM_LABEL,
+    VM_GOTO,
+    VM_IF,
+    VM_CALL,
+    VM_FUNCTION,
+    VM_RETURN
 };
\ No newline at end of file
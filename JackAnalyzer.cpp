@@ -1,32 +1,118 @@
 
 #include "JackAnalyzer.hpp"
 #include "CompilationEngine.hpp"
+#include "AllocationTracker.hpp"
 #include <string>
 #include <filesystem>
 #include <stdexcept>
 #include <iostream>
+#include <sstream>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <algorithm>
 
-JackAnalyzer::JackAnalyzer(std::string inputFilePath) : path(inputFilePath) {}
+JackAnalyzer::JackAnalyzer(std::string inputFilePath, CompilerOptions options) : path(inputFilePath), options(options) {}
 
 void JackAnalyzer::generateVM() {
     std::cout << "Began compiling files in " << path.string() << std::endl;
+    AllocationTracker::Phase build("build");
+    // a single file is compiled against the signatures of the other classes in its directory
+    std::filesystem::path projectDir = std::filesystem::is_directory(path) ? path : path.parent_path();
+    if (projectDir.empty()) projectDir = ".";
+    std::vector<std::filesystem::path> sources;
     if (std::filesystem::is_regular_file(path)) {
-        generateVMForSingleFile(path);
+        sources.push_back(path);
     }
     else if (std::filesystem::is_directory(path)) {
         for (const auto& entry : std::filesystem::directory_iterator(path)) {
             if (entry.is_regular_file() && entry.path().extension().string() == ".jack") {
-                generateVMForSingleFile(entry.path());
+                sources.push_back(entry.path());
             }
         }
     }
+    std::sort(sources.begin(), sources.end()); // directory order is unspecified; keep builds reproducible
+    // every source is requested at once; the index rescans changed files from the same reads,
+    // and each source is compiled as soon as it has arrived
+    BatchedIO io;
+    std::vector<size_t> reads;
+    std::unordered_map<std::string, size_t> sourceOfFile; // by file name, all in projectDir
+    for (size_t i = 0; i < sources.size(); i++) {
+        reads.push_back(io.submitRead(sources[i]));
+        sourceOfFile[sources[i].filename().string()] = i;
+    }
+    std::vector<std::optional<std::string>> contents(sources.size());
+    auto awaitSource = [&](size_t i) -> std::string& {
+        if (!contents[i]) contents[i] = io.awaitRead(reads[i]);
+        return *contents[i];
+    };
+    std::string otherSource; // a class of the directory that is not being compiled
+    ClassIndex classIndex = [&]() {
+        AllocationTracker::Phase phase("index");
+        return ClassIndex(projectDir, [&](const std::filesystem::path& file) -> const std::string& {
+            auto source = sourceOfFile.find(file.filename().string());
+            if (source != sourceOfFile.end()) return awaitSource(source->second);
+            otherSource = io.awaitRead(io.submitRead(file));
+            return otherSource;
+        });
+    }();
+    std::cout << "Indexed " << classIndex.rescanned() << " changed files in " << projectDir.string() << std::endl;
+    Profiler profiler(projectDir);
+    if (!options.profilePath.empty()) {
+        AllocationTracker::Phase phase("profile");
+        profiler.readCounts(options.profilePath);
+    }
+    Bundler bundler(profiler);
+    CodeReport codeReport;
+    for (size_t i = 0; i < sources.size(); i++) {
+        std::string source = std::move(awaitSource(i));
+        contents[i].reset();
+        generateVMForSingleFile(sources[i], std::move(source), classIndex, profiler, bundler, codeReport, io);
+    }
+    io.finish();
+    if (options.instrument) {
+        AllocationTracker::Phase phase("profile runtime");
+        if (options.bundlePath.empty()) {
+            VMWriter<FileSink> vmWriter(projectDir / "Profile.vm");
+            profiler.writeRuntime(vmWriter);
+        }
+        else {
+            VMWriter<MemorySink> vmWriter;
+            profiler.writeRuntime(vmWriter);
+            bundler.addClass(vmWriter.contents(), vmWriter.getLineMap());
+        }
+    }
+    if (!options.bundlePath.empty()) {
+        AllocationTracker::Phase phase("bundle");
+        bundler.write(options.bundlePath);
+        std::cout << "Wrote " << options.bundlePath << std::endl;
+    }
+    if (options.codeReport) {
+        AllocationTracker::Phase phase("code report");
+        codeReport.write(projectDir);
+        std::cout << "Wrote the code report to " << (projectDir / "CodeReport.txt").string() << std::endl;
+    }
     std::cout << "Finished compiling files in " << path.string() << std::endl;
 }
 
-void JackAnalyzer::generateVMForSingleFile(std::filesystem::path inputPath) {
-    std::filesystem::path outputPath = inputPath.parent_path() / (inputPath.stem().string() + ".vm");
-    CompilationEngine compilationEngine(inputPath, outputPath);
+// Queues the class to be written next to its source, or adds it to the bundle in bundle mode.
+void JackAnalyzer::generateVMForSingleFile(std::filesystem::path inputPath, std::string source, const ClassIndex& classIndex, Profiler& profiler, Bundler& bundler, CodeReport& codeReport, BatchedIO& io) {
     std::cout << "Began compiling " << inputPath.filename().string() << std::endl;
+    AllocationTracker::Phase phase(inputPath.filename().string());
+    CompilationEngine compilationEngine(inputPath, std::move(source), classIndex, profiler, options);
     compilationEngine.compileClass();
+    if (options.bundlePath.empty()) {
+        std::filesystem::path outputPath = inputPath.parent_path() / (inputPath.stem().string() + ".vm");
+        io.submitWrite(outputPath, compilationEngine.output());
+        if (options.lineMap) {
+            std::ostringstream map;
+            compilationEngine.getLineMap().write(map);
+            io.submitWrite(outputPath.string() + ".map", map.str());
+        }
+    }
+    else {
+        bundler.addClass(compilationEngine.output(), compilationEngine.getLineMap());
+    }
+    codeReport.addClass(inputPath.filename().string(), compilationEngine.getMetrics());
     std::cout << "Finished compiling " << inputPath.filename().string() << std::endl;
 }
\ No newline at end of file
@@ -1,13 +1,20 @@
 #pragma once
 
 #include <filesystem>
+#include "CompilerOptions.hpp"
+#include "ClassIndex.hpp"
+#include "Profiler.hpp"
+#include "Bundler.hpp"
+#include "CodeReport.hpp"
+#include "BatchedIO.hpp"
 
 class JackAnalyzer {
 public:
-    JackAnalyzer(std::string inputFilePath);
+    JackAnalyzer(std::string inputFilePath, CompilerOptions options);
     void generateVM();
 private:
     bool isDir;
-    void generateVMForSingleFile(std::filesystem::path inputPath);
+    void generateVMForSingleFile(std::filesystem::path inputPath, std::string source, const ClassIndex& classIndex, Profiler& profiler, Bundler& bundler, CodeReport& codeReport, BatchedIO& io);
     std::filesystem::path path;
+    CompilerOptions options;
 };
\ No newline at end of file
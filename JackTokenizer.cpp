@@ -1,38 +1,72 @@
 #include "JackTokenizer.hpp"
 #include "Enums.hpp"
+#include "KeyWords.hpp"
 
 #include <fstream>
+#include <sstream>
 #include <filesystem>
 #include <iostream>
 #include <stdexcept>
-#include <vector>
-#include <algorithm>
-#include <unordered_map>
 
-JackTokenizer::JackTokenizer(std::filesystem::path inputPath) : lineNumber(0) {
-    input = std::ifstream(inputPath);
+JackTokenizer::JackTokenizer(std::filesystem::path inputPath) : position(0), pastEnd(false), lineNumber(0), lineStart(0), tokenStart(0), tokenLine(0) {
+    std::ifstream input(inputPath, std::ios::binary);
     if (!input) {
         throw std::runtime_error("JackTokenizer: the requested file could not be opened.");
     }
+    std::ostringstream contents;
+    contents << input.rdbuf();
+    source = contents.str();
+    advanceChar();
+}
+
+JackTokenizer::JackTokenizer(std::string source, int firstLine, int firstColumn) : source(std::move(source)), position(0), pastEnd(false), lineNumber(firstLine), lineStart(1 - firstColumn), tokenStart(0), tokenLine(firstLine) {
     advanceChar();
 }
 
 bool JackTokenizer::hasMoreTokens() {
     skipWhitespaceAndComments();
-    return (!input.eof());
+    return !atEnd();
 }
 
 int JackTokenizer::getLineNumber() {
     return lineNumber;
 }
 
+size_t JackTokenizer::tokenPosition() {
+    return tokenStart;
+}
+
+int JackTokenizer::tokenLineNumber() {
+    return tokenLine;
+}
+
+int JackTokenizer::tokenColumnNumber() {
+    return static_cast<long>(tokenStart) - lineStart + 1;
+}
+
+const std::string& JackTokenizer::getSource() {
+    return source;
+}
+
+bool JackTokenizer::atEnd() {
+    return pastEnd;
+}
+
 char JackTokenizer::getChar() {
-    return input.peek();
+    return position < source.size() ? source[position] : EOF;
 }
 
 void JackTokenizer::advanceChar() {
-    currentChar = input.get();
-    if (currentChar == '\n') lineNumber++;
+    if (position >= source.size()) {
+        currentChar = EOF;
+        pastEnd = true;
+        return;
+    }
+    currentChar = source[position++];
+    if (currentChar == '\n') {
+        lineNumber++;
+        lineStart = position;
+    }
 }
 
 bool JackTokenizer::isSymbol(char c) {
@@ -41,7 +75,7 @@ bool JackTokenizer::isSymbol(char c) {
 }
 
 void JackTokenizer::skipWhitespaceAndComments() {
-    while (!input.eof()) {
+    while (!atEnd()) {
         if (std::isspace(currentChar)) {
             advanceChar();
         }
@@ -49,14 +83,14 @@ void JackTokenizer::skipWhitespaceAndComments() {
             if (getChar() == '/') {
                 advanceChar();
                 advanceChar();
-                while (!input.eof() && currentChar != '\n') {
+                while (!atEnd() && currentChar != '\n') {
                     advanceChar();
                 }
             }
             else if (getChar() == '*') {
                 advanceChar();
                 advanceChar();
-                while (!input.eof()) {
+                while (!atEnd()) {
                     if (currentChar == '*' && getChar() == '/') {
                         advanceChar();
                         advanceChar();
@@ -78,10 +112,13 @@ void JackTokenizer::skipWhitespaceAndComments() {
 void JackTokenizer::advance() {
     if (!hasMoreTokens()) return;
     currentToken.clear();
+    tokenKeyWord.reset();
+    tokenStart = position - 1;
+    tokenLine = lineNumber;
     if (currentChar == '"') {
         currentToken += currentChar;
         advanceChar();
-        while (!input.eof() && currentChar != '"') {
+        while (!atEnd() && currentChar != '"') {
             currentToken += currentChar;
             advanceChar();
         }
@@ -93,13 +130,14 @@ void JackTokenizer::advance() {
         advanceChar();
     }
     else if (std::isalpha(currentChar) || currentChar == '_') {
-        while (!input.eof() && (std::isalnum(currentChar) || currentChar == '_')) {
+        while (!atEnd() && (std::isalnum(currentChar) || currentChar == '_')) {
             currentToken += currentChar;
             advanceChar();
         }
+        tokenKeyWord = findKeyWord(currentToken); // classified once, here
     }
     else if (std::isdigit(currentChar)) {
-        while (!input.eof() && std::isdigit(currentChar)) {
+        while (!atEnd() && std::isdigit(currentChar)) {
             currentToken += currentChar;
             advanceChar();
         }
@@ -107,22 +145,15 @@ void JackTokenizer::advance() {
 }
 
 TokenType JackTokenizer::tokenType() {
-    static const std::vector<std::string> keyWords = {
-        "class", "method", "function", "constructor",
-        "int", "boolean", "char", "void", "var", "static",
-        "field", "let", "do", "if", "else", "while", "return",
-        "true", "false", "null", "this"
-    };
-
-    if (std::isdigit(currentToken[0])) {
+    if (tokenKeyWord) {
+        return KEYWORD;
+    }
+    else if (std::isdigit(currentToken[0])) {
         return INT_CONST;
     }
     else if (isSymbol(currentToken[0])) {
         return SYMBOL;
     }
-    else if (std::find(keyWords.begin(), keyWords.end(), currentToken) != keyWords.end()) {
-        return KEYWORD;
-    }
     else if (currentToken[0] == '"') {
         return STRING_CONST;
     }
@@ -135,35 +166,10 @@ TokenType JackTokenizer::tokenType() {
 }
 
 KeyWord JackTokenizer::keyWord() {
-    if (tokenType() != KEYWORD) {
+    if (!tokenKeyWord) {
         throw std::runtime_error("JackTokenizer: keyWord() was called when the current token is not a keyword!");
     }
-
-    static const std::unordered_map<std::string, KeyWord> keyWordLookUp = {
-        {"class", KW_CLASS},
-        {"method", KW_METHOD},
-        {"function", KW_FUNCTION},
-        {"constructor", KW_CONSTRUCTOR},
-        {"int", KW_INT},
-        {"boolean", KW_BOOLEAN},
-        {"char", KW_CHAR},
-        {"void", KW_VOID},
-        {"var", KW_VAR},
-        {"static", KW_STATIC},
-        {"field", KW_FIELD},
-        {"let", KW_LET},
-        {"do", KW_DO},
-        {"if", KW_IF},
-        {"else", KW_ELSE},
-        {"while", KW_WHILE},
-        {"return", KW_RETURN},
-        {"true", KW_TRUE},
-        {"false", KW_FALSE},
-        {"null", KW_NULL},
-        {"this", KW_THIS}
-    };
-
-    return keyWordLookUp.at(currentToken);
+    return *tokenKeyWord;
 }
 
 char JackTokenizer::symbol() {
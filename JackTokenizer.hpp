@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Enums.hpp"
+#include <optional>
 #include <string>
 #include <fstream>
 #include <filesystem>
@@ -8,11 +9,17 @@
 class JackTokenizer {
 public:
     JackTokenizer(std::filesystem::path inputFile);
+    // Tokenizes a slice of a source file whose first character is at `firstLine`, `firstColumn`.
+    JackTokenizer(std::string source, int firstLine, int firstColumn);
     bool hasMoreTokens();
     void advance();
     TokenType tokenType();
     KeyWord keyWord();
     int getLineNumber();
+    size_t tokenPosition(); // offset of the current token in the source
+    int tokenLineNumber();
+    int tokenColumnNumber(); // from 1
+    const std::string& getSource();
     char symbol();
     std::string type();
     std::string identifier();
@@ -23,8 +30,15 @@ private:
     char getChar();
     void advanceChar();
     bool isSymbol(char c);
-    std::ifstream input;
+    bool atEnd();
+    std::string source;
+    size_t position; // offset of the character after currentChar
+    bool pastEnd;
     char currentChar;
     int lineNumber;
+    long lineStart; // offset of the first character of the current line
+    size_t tokenStart;
+    int tokenLine;
+    std::optional<KeyWord> tokenKeyWord; // set when the current token is a keyword
     void skipWhitespaceAndComments();
 };
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Enums.hpp"
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+// Recognition of the Jack keywords, shared by the tokenizer and the code generator. A word is
+// hashed from its length and its first and last characters into a table built at compile time,
+// so telling a keyword from an identifier takes one probe and one comparison, and allocates
+// nothing.
+
+// Indexed by KeyWord.
+constexpr std::array<std::string_view, KW_THIS + 1> keyWordNames = {
+    "class", "method", "function", "constructor",
+    "int", "boolean", "char", "void", "var", "static",
+    "field", "let", "do", "if", "else", "while", "return",
+    "true", "false", "null", "this"
+};
+
+constexpr size_t keyWordTableSize = 32;
+
+// The constants were searched for to give each keyword its own slot; see keyWordTable.
+constexpr size_t keyWordHash(size_t length, char first, char last) {
+    return (length * 5 + static_cast<unsigned char>(first) * 8 + static_cast<unsigned char>(last) * 7) % keyWordTableSize;
+}
+
+// Each slot holds its keyword + 1, or 0 when it is empty. Two keywords in one slot make the
+// table invalid, which fails the build below.
+constexpr std::array<unsigned char, keyWordTableSize> buildKeyWordTable() {
+    std::array<unsigned char, keyWordTableSize> table{};
+    for (size_t keyWord = 0; keyWord < keyWordNames.size(); keyWord++) {
+        std::string_view name = keyWordNames[keyWord];
+        unsigned char& slot = table[keyWordHash(name.size(), name.front(), name.back())];
+        if (slot != 0) return {};
+        slot = static_cast<unsigned char>(keyWord + 1);
+    }
+    return table;
+}
+
+constexpr std::array<unsigned char, keyWordTableSize> keyWordTable = buildKeyWordTable();
+
+constexpr size_t longestKeyWord = 11; // constructor
+
+// The keyword spelled by `word`, or nothing when it is an identifier.
+constexpr std::optional<KeyWord> findKeyWord(std::string_view word) {
+    if (word.size() < 2 || word.size() > longestKeyWord) return std::nullopt;
+    unsigned char slot = keyWordTable[keyWordHash(word.size(), word.front(), word.back())];
+    if (slot == 0 || keyWordNames[slot - 1] != word) return std::nullopt;
+    return static_cast<KeyWord>(slot - 1);
+}
+
+// The spelling of `keyWord`, for error messages.
+constexpr std::string_view keyWordName(KeyWord keyWord) {
+    return keyWordNames[keyWord];
+}
+
+static_assert(findKeyWord("class") == KW_CLASS, "the keyword table has a collision");
+static_assert(findKeyWord("constructor") == KW_CONSTRUCTOR && findKeyWord("this") == KW_THIS, "the keyword table is wrong");
+static_assert(!findKeyWord("classes") && !findKeyWord("thus") && !findKeyWord("x"), "the keyword table accepts identifiers");
@@ -0,0 +1,66 @@
+#include "LineMap.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+void LineMap::addFunction(FunctionPositions function) {
+    functions.push_back(std::move(function));
+}
+
+void LineMap::append(const LineMap& other) {
+    functions.insert(functions.end(), other.functions.begin(), other.functions.end());
+}
+
+const FunctionPositions* LineMap::find(const std::string& name) const {
+    for (const FunctionPositions& function : functions) {
+        if (function.name == name) return &function;
+    }
+    return nullptr;
+}
+
+bool LineMap::empty() const {
+    return functions.empty();
+}
+
+void LineMap::write(std::filesystem::path mapPath) const {
+    std::ofstream output(mapPath);
+    if (!output) {
+        throw std::runtime_error("LineMap: unable to open " + mapPath.string() + " for writing.");
+    }
+    write(output);
+}
+
+void LineMap::write(std::ostream& output) const {
+    output << "jackmap 1\n";
+    std::unordered_map<std::string, int> fileNumbers;
+    for (const FunctionPositions& function : functions) {
+        std::string file = function.file.empty() ? "-" : function.file;
+        if (fileNumbers.count(file)) continue;
+        int number = fileNumbers.size();
+        fileNumbers[file] = number;
+        output << "file " << number << ' ' << file << '\n';
+    }
+    size_t first = 0;
+    for (const FunctionPositions& function : functions) {
+        output << "function " << function.name << ' ' << fileNumbers[function.file.empty() ? "-" : function.file]
+            << ' ' << first << ' ' << function.positions.size() << '\n';
+        first += function.positions.size();
+    }
+
+    output << "positions\n";
+    size_t command = 0;
+    size_t lastCommand = 0;
+    SourcePosition last = {0, 0};
+    for (const FunctionPositions& function : functions) {
+        for (size_t i = 0; i < function.positions.size(); i++) {
+            // unknown positions continue the previous row, except at the start of a function
+            const SourcePosition& position = function.positions[i];
+            if ((position.line != 0 || i == 0) && (position.line != last.line || position.column != last.column)) {
+                output << command - lastCommand << ' ' << position.line - last.line << ' ' << position.column - last.column << '\n';
+                lastCommand = command;
+                last = position;
+            }
+            command++;
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A Jack source position; line 0 means unknown, e.g. for code added by the optimizer.
+struct SourcePosition {
+    int line;
+    int column;
+};
+
+// The source position of every VM command of one function, in output order.
+struct FunctionPositions {
+    std::string name;
+    std::string file;
+    std::vector<SourcePosition> positions;
+};
+
+// Maps the commands of a .vm file back to Jack source lines, for --line-map. Written as
+// `<output>.vm.map`:
+//
+//   jackmap 1
+//   file <fileNumber> <name>
+//   function <name> <fileNumber> <firstCommand> <nCommands>
+//   positions
+//   <commandDelta> <lineDelta> <columnDelta>
+//
+// Commands are numbered from 0 in file order, labels included. A positions row is written
+// only where the position changes, as deltas from the previous row (starting from 0 0 0),
+// and holds until the next row; the file comes from the function containing the command.
+// Line 0 marks commands with no source position, such as the generated Profile class.
+class LineMap {
+public:
+    void addFunction(FunctionPositions function);
+    void append(const LineMap& other);
+    const FunctionPositions* find(const std::string& name) const;
+    bool empty() const;
+    void write(std::filesystem::path mapPath) const;
+    void write(std::ostream& output) const;
+private:
+    std::vector<FunctionPositions> functions;
+};
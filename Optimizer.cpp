@@ -0,0 +1,337 @@
+#include "Optimizer.hpp"
+#include "Enums.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+Optimizer::Optimizer() : memoryVersion(0), lastTemp(7) {}
+
+// Keeps the CSE out of temp `firstReserved` and above, which then hold values across calls.
+void Optimizer::reserveTemps(int firstReserved) {
+    lastTemp = firstReserved - 1;
+}
+
+// Shares local slots between variables that are never live at the same time and shrinks the
+// `function` command's nVars to the number of slots actually needed. Stores into dead locals
+// (such as the clearing done by self tail calls) are dropped first.
+void Optimizer::packLocals(std::vector<VMCommand>& commands) {
+    if (commands.empty() || commands[0].op != VM_FUNCTION || commands[0].index == 0) return;
+    int nLocals = commands[0].index;
+
+    removeDeadStores(commands, liveOut(commands, nLocals));
+    std::vector<LiveSet> live = liveOut(commands, nLocals);
+
+    // two locals interfere when one is written while the other is still needed
+    std::vector<LiveSet> interferes(nLocals, LiveSet(nLocals, false));
+    std::vector<bool> isUsed(nLocals, false);
+    for (size_t i = 0; i < commands.size(); i++) {
+        const VMCommand& command = commands[i];
+        if ((command.op != VM_PUSH && command.op != VM_POP) || command.arg != "local") continue;
+        isUsed[command.index] = true;
+        if (command.op == VM_POP) {
+            for (int other = 0; other < nLocals; other++) {
+                if (other != command.index && live[i][other]) {
+                    interferes[command.index][other] = true;
+                    interferes[other][command.index] = true;
+                }
+            }
+        }
+    }
+
+    std::vector<int> slot(nLocals, -1);
+    int nSlots = 0;
+    for (int local = 0; local < nLocals; local++) {
+        if (!isUsed[local]) continue;
+        std::vector<bool> isTaken(nSlots, false);
+        for (int other = 0; other < nLocals; other++) {
+            if (interferes[local][other] && slot[other] != -1) {
+                isTaken[slot[other]] = true;
+            }
+        }
+        slot[local] = 0;
+        while (slot[local] < nSlots && isTaken[slot[local]]) {
+            slot[local]++;
+        }
+        if (slot[local] == nSlots) nSlots++;
+    }
+
+    for (VMCommand& command : commands) {
+        if ((command.op == VM_PUSH || command.op == VM_POP) && command.arg == "local") {
+            command.index = slot[command.index];
+        }
+    }
+    commands[0].index = nSlots;
+}
+
+// Backward dataflow over the commands; returns the locals live after each command.
+std::vector<Optimizer::LiveSet> Optimizer::liveOut(const std::vector<VMCommand>& commands, int nLocals) {
+    labels.clear();
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (commands[i].op == VM_LABEL) {
+            labels[commands[i].arg] = i;
+        }
+    }
+
+    std::vector<LiveSet> liveIn(commands.size(), LiveSet(nLocals, false));
+    std::vector<LiveSet> out(commands.size(), LiveSet(nLocals, false));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = commands.size(); i-- > 0;) {
+            LiveSet live(nLocals, false);
+            for (size_t next : successors(commands, i)) {
+                for (int local = 0; local < nLocals; local++) {
+                    if (liveIn[next][local]) live[local] = true;
+                }
+            }
+            if (live != out[i]) {
+                out[i] = live;
+                changed = true;
+            }
+            const VMCommand& command = commands[i];
+            if (command.arg == "local" && command.op == VM_POP) live[command.index] = false;
+            if (command.arg == "local" && command.op == VM_PUSH) live[command.index] = true;
+            if (live != liveIn[i]) {
+                liveIn[i] = live;
+                changed = true;
+            }
+        }
+    }
+    return out;
+}
+
+std::vector<size_t> Optimizer::successors(const std::vector<VMCommand>& commands, size_t i) {
+    std::vector<size_t> next;
+    const VMCommand& command = commands[i];
+    if (command.op == VM_GOTO || command.op == VM_IF) {
+        next.push_back(labels.at(command.arg));
+    }
+    if (command.op != VM_GOTO && command.op != VM_RETURN && i + 1 < commands.size()) {
+        next.push_back(i + 1);
+    }
+    return next;
+}
+
+// Removes `push x; pop local k` pairs whose stored value is never read.
+void Optimizer::removeDeadStores(std::vector<VMCommand>& commands, const std::vector<LiveSet>& live) {
+    std::vector<bool> isDead(commands.size(), false);
+    for (size_t i = 1; i < commands.size(); i++) {
+        const VMCommand& command = commands[i];
+        if (command.op == VM_POP && command.arg == "local" && !live[i][command.index] && commands[i - 1].op == VM_PUSH) {
+            isDead[i - 1] = true;
+            isDead[i] = true;
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (!isDead[i]) {
+            commands[kept++] = commands[i];
+        }
+    }
+    commands.resize(kept);
+}
+
+// Caches repeated pure subexpressions of a basic block in temp 2..lastTemp: the first computation is
+// followed by `pop temp k; push temp k` and later ones become `push temp k`. Stores change the
+// value numbers of what they overwrite, and calls end every cached value since callees may use
+// the same temps. Returns the number of VM instructions removed.
+int Optimizer::eliminateCommonSubexpressions(std::vector<VMCommand>& commands) {
+    const int firstTemp = 2;
+    const int saveCost = estimatedCost({VM_POP, "temp", 0}) + estimatedCost({VM_PUSH, "temp", 0});
+    const int reuseCost = estimatedCost({VM_PUSH, "temp", 0});
+
+    valueNumbers.clear();
+    leafVersions.clear();
+    std::vector<StackValue> stack;
+    std::unordered_map<int, Occurrence> available;
+    std::vector<int> registered; // value numbers in the order their first computation ended
+    int nextTemp = firstTemp;
+    std::unordered_map<size_t, int> saves; // temp to save into before the command at an index
+    std::vector<Occurrence> replacements;  // code to replace by `push temp k`
+    std::vector<int> costBefore(1, 0);
+    for (const VMCommand& command : commands) {
+        costBefore.push_back(costBefore.back() + estimatedCost(command));
+    }
+
+    auto popValue = [&stack]() {
+        if (stack.empty()) return StackValue{-1, 0};
+        StackValue value = stack.back();
+        stack.pop_back();
+        return value;
+    };
+    auto forgetStack = [&stack]() {
+        for (StackValue& value : stack) value.number = -1;
+    };
+    auto forgetAvailable = [&]() {
+        available.clear();
+        registered.clear();
+        nextTemp = firstTemp;
+    };
+
+    for (size_t i = 0; i < commands.size(); i++) {
+        const VMCommand& command = commands[i];
+        StackValue result = {-1, i};
+        std::string key;
+        switch (command.op) {
+            case VM_PUSH:
+                key = leafKey(command);
+                break;
+            case VM_POP: {
+                popValue();
+                leafVersions[command.arg + " " + std::to_string(command.index)]++;
+                if (command.arg == "this" || command.arg == "that" || command.arg == "static" || command.arg == "pointer") {
+                    memoryVersion++;
+                }
+                forgetStack(); // code computing the values below would span the store
+                continue;
+            }
+            case VM_ARITHMETIC:
+                if (command.arg == "neg" || command.arg == "not") {
+                    StackValue operand = popValue();
+                    result.start = operand.start;
+                    if (operand.number != -1) key = command.arg + " " + std::to_string(operand.number);
+                }
+                else {
+                    StackValue right = popValue();
+                    StackValue left = popValue();
+                    result.start = left.start;
+                    if (left.number != -1 && right.number != -1) {
+                        int a = left.number, b = right.number;
+                        if ((command.arg == "add" || command.arg == "and" || command.arg == "or" || command.arg == "eq") && b < a) {
+                            std::swap(a, b);
+                        }
+                        key = command.arg + " " + std::to_string(a) + " " + std::to_string(b);
+                    }
+                }
+                break;
+            case VM_CALL: {
+                std::vector<StackValue> args;
+                for (int arg = 0; arg < command.index; arg++) {
+                    args.insert(args.begin(), popValue());
+                }
+                if (!args.empty()) result.start = args[0].start;
+                bool isPure = (command.arg == "Math.multiply" || command.arg == "Math.divide") && command.index == 2;
+                if (isPure && args[0].number != -1 && args[1].number != -1) {
+                    int a = args[0].number, b = args[1].number;
+                    if (command.arg == "Math.multiply" && b < a) std::swap(a, b);
+                    key = command.arg + " " + std::to_string(a) + " " + std::to_string(b);
+                }
+                else if (!isPure) {
+                    memoryVersion++;
+                    forgetStack();
+                }
+                break;
+            }
+            default: // labels, jumps and returns end the basic block
+                if (command.op == VM_IF || command.op == VM_RETURN) popValue();
+                forgetStack();
+                forgetAvailable();
+                continue;
+        }
+
+        if (!key.empty()) {
+            result.number = valueNumber(key);
+            auto first = available.find(result.number);
+            if (first != available.end()) {
+                Occurrence& occurrence = first->second;
+                int cost = costBefore[i + 1] - costBefore[result.start];
+                bool needsSave = occurrence.temp == -1;
+                if (cost > reuseCost + (needsSave ? saveCost : 0) && (!needsSave || nextTemp <= lastTemp)) {
+                    if (needsSave) {
+                        occurrence.temp = nextTemp++;
+                        saves[occurrence.end] = occurrence.temp;
+                    }
+                    replacements.push_back({result.start, i + 1, occurrence.temp});
+                    // values first computed inside the replaced code are gone with it
+                    while (!registered.empty() && available.at(registered.back()).start >= result.start) {
+                        available.erase(registered.back());
+                        registered.pop_back();
+                    }
+                    stack.push_back(result);
+                    continue;
+                }
+            }
+        }
+        if (command.op == VM_CALL) {
+            forgetAvailable(); // the callee may use the same temps
+        }
+        if (result.number != -1 && !available.count(result.number)) {
+            available[result.number] = {result.start, i + 1, -1};
+            registered.push_back(result.number);
+        }
+        stack.push_back(result);
+    }
+
+    // outer replacements first, so that code nested inside them is dropped with them
+    std::sort(replacements.begin(), replacements.end(), [](const Occurrence& a, const Occurrence& b) {
+        return a.start < b.start || (a.start == b.start && a.end > b.end);
+    });
+    std::vector<VMCommand> optimized;
+    optimized.reserve(commands.size() + 2 * saves.size());
+    size_t next = 0;
+    for (size_t i = 0; i <= commands.size();) {
+        auto save = saves.find(i);
+        if (save != saves.end()) {
+            optimized.push_back({VM_POP, "temp", save->second});
+            optimized.push_back({VM_PUSH, "temp", save->second});
+        }
+        if (i == commands.size()) break;
+        while (next < replacements.size() && replacements[next].start < i) next++;
+        if (next < replacements.size() && replacements[next].start == i) {
+            optimized.push_back({VM_PUSH, "temp", replacements[next].temp});
+            i = replacements[next].end;
+            continue;
+        }
+        optimized.push_back(commands[i]);
+        i++;
+    }
+    int eliminated = commands.size() - optimized.size();
+    commands.swap(optimized);
+    return eliminated;
+}
+
+// Approximate number of Hack instructions a typical VM translator emits for the command.
+int Optimizer::estimatedCost(const VMCommand& command) {
+    switch (command.op) {
+        case VM_PUSH:
+            if (command.arg == "constant") return 7;
+            if (command.arg == "static" || command.arg == "temp" || command.arg == "pointer") return 6;
+            return 10;
+        case VM_POP:
+            if (command.arg == "static" || command.arg == "temp" || command.arg == "pointer") return 5;
+            return 13;
+        case VM_ARITHMETIC:
+            if (command.arg == "neg" || command.arg == "not") return 3;
+            if (command.arg == "eq" || command.arg == "gt" || command.arg == "lt") return 15;
+            return 5;
+        case VM_LABEL: return 0;
+        case VM_GOTO: return 2;
+        case VM_IF: return 5;
+        case VM_CALL: return 45;
+        case VM_FUNCTION: return 2 + 4 * command.index;
+        case VM_RETURN: return 45;
+    }
+    return 0;
+}
+
+// The key of a pushed value, versioned so that it no longer matches once the source is overwritten.
+std::string Optimizer::leafKey(const VMCommand& command) {
+    std::string leaf = command.arg + " " + std::to_string(command.index);
+    if (command.arg == "constant") return leaf;
+    std::string key = leaf + " v" + std::to_string(leafVersions[leaf]);
+    if (command.arg == "this" || command.arg == "that" || command.arg == "static") {
+        key += " m" + std::to_string(memoryVersion);
+    }
+    if (command.arg == "this") key += " p" + std::to_string(leafVersions["pointer 0"]);
+    if (command.arg == "that") key += " p" + std::to_string(leafVersions["pointer 1"]);
+    return key;
+}
+
+int Optimizer::valueNumber(const std::string& key) {
+    auto number = valueNumbers.find(key);
+    if (number != valueNumbers.end()) return number->second;
+    int next = valueNumbers.size();
+    valueNumbers[key] = next;
+    return next;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "VMWriter.hpp"
+
+// Rewrites the buffered VM commands of one subroutine, starting at its `function` command.
+class Optimizer {
+public:
+    Optimizer();
+    void reserveTemps(int firstReserved);
+    void packLocals(std::vector<VMCommand>& commands);
+    int eliminateCommonSubexpressions(std::vector<VMCommand>& commands);
+    int estimatedCost(const VMCommand& command);
+private:
+    typedef std::vector<bool> LiveSet;
+
+    // A value on the simulated VM stack: its value number (-1 when unknown) and the
+    // first command of the code that computes it.
+    struct StackValue {
+        int number;
+        size_t start;
+    };
+    // The commands [start, end) that compute a value, and the temp slot holding it (-1 if none).
+    struct Occurrence {
+        size_t start;
+        size_t end;
+        int temp;
+    };
+
+    std::vector<LiveSet> liveOut(const std::vector<VMCommand>& commands, int nLocals);
+    std::vector<size_t> successors(const std::vector<VMCommand>& commands, size_t i);
+    void removeDeadStores(std::vector<VMCommand>& commands, const std::vector<LiveSet>& live);
+    std::string leafKey(const VMCommand& command);
+    int valueNumber(const std::string& key);
+
+    std::unordered_map<std::string, size_t> labels;
+    std::unordered_map<std::string, int> valueNumbers;
+    std::unordered_map<std::string, int> leafVersions; // bumped by every store to the leaf
+    int memoryVersion; // bumped by stores through this/that/static and by calls
+    int lastTemp;      // highest temp the CSE may cache values in
+};
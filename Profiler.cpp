@@ -0,0 +1,195 @@
+#include "Profiler.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+Profiler::Profiler(std::filesystem::path projectDir) : projectDir(projectDir) {
+    std::ifstream map(projectDir / "Profile.map");
+    int number;
+    std::string name;
+    while (map >> number >> name) {
+        if (number < 0) continue;
+        if (names.size() <= static_cast<size_t>(number)) names.resize(number + 1);
+        names[number] = name;
+        numbers[name] = number;
+    }
+}
+
+// The number of the named counter, allocating a new one the first time a name is seen.
+int Profiler::counter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = numbers.find(name);
+    if (found != numbers.end()) return found->second;
+    int number = names.size();
+    names.push_back(name);
+    numbers[name] = number;
+    return number;
+}
+
+// Writes Profile.map and the Profile class. Each counter takes two words, low and high, so
+// that it can count past the 16-bit range. Profile.hit allocates and clears them on first use.
+// Static 1 is set while Profile.init runs: a project's own Memory class is instrumented too, and
+// its hits during the allocation are dropped instead of starting Profile.init again.
+template <typename Sink>
+void Profiler::writeRuntime(VMWriter<Sink>& vmWriter) {
+    writeMap();
+    int nWords = std::max<int>(1, 2 * names.size());
+
+    vmWriter.writeFunction("Profile.init", 1);
+    vmWriter.writePush("constant", 1);
+    vmWriter.writePop("static", 1);
+    vmWriter.writePush("constant", nWords);
+    vmWriter.writeCall("Memory.alloc", 1);
+    vmWriter.writePop("static", 0);
+    vmWriter.writeLabel("CLEAR");
+    vmWriter.writePush("local", 0);
+    vmWriter.writePush("constant", nWords);
+    vmWriter.writeArithmetic("lt");
+    vmWriter.writeArithmetic("not");
+    vmWriter.writeIf("CLEARED");
+    vmWriter.writePush("static", 0);
+    vmWriter.writePush("local", 0);
+    vmWriter.writeArithmetic("add");
+    vmWriter.writePop("pointer", 1);
+    vmWriter.writePush("constant", 0);
+    vmWriter.writePop("that", 0);
+    vmWriter.writePush("local", 0);
+    vmWriter.writePush("constant", 1);
+    vmWriter.writeArithmetic("add");
+    vmWriter.writePop("local", 0);
+    vmWriter.writeGoTo("CLEAR");
+    vmWriter.writeLabel("CLEARED");
+    vmWriter.writePush("constant", 0);
+    vmWriter.writeReturn();
+    vmWriter.flush();
+
+    vmWriter.writeFunction("Profile.hit", 0);
+    vmWriter.writePush("static", 0);
+    vmWriter.writeIf("READY");
+    vmWriter.writePush("static", 1);
+    vmWriter.writeIf("DONE"); // called from within Profile.init
+    vmWriter.writeCall("Profile.init", 0);
+    vmWriter.writePop("temp", 0);
+    vmWriter.writeLabel("READY");
+    vmWriter.writePush("static", 0);
+    vmWriter.writePush("argument", 0);
+    vmWriter.writePush("argument", 0);
+    vmWriter.writeArithmetic("add");
+    vmWriter.writeArithmetic("add");
+    vmWriter.writePop("pointer", 1);
+    vmWriter.writePush("that", 0);
+    vmWriter.writePush("constant", 1);
+    vmWriter.writeArithmetic("add");
+    vmWriter.writePop("that", 0);
+    vmWriter.writePush("that", 0);
+    vmWriter.writeIf("DONE"); // the low word wrapped around to 0: carry
+    vmWriter.writePush("that", 1);
+    vmWriter.writePush("constant", 1);
+    vmWriter.writeArithmetic("add");
+    vmWriter.writePop("that", 1);
+    vmWriter.writeLabel("DONE");
+    vmWriter.writePush("constant", 0);
+    vmWriter.writeReturn();
+    vmWriter.flush();
+
+    // prints `#id high low` for every counter that was hit
+    vmWriter.writeFunction("Profile.dump", 1);
+    vmWriter.writePush("static", 0);
+    vmWriter.writeIf("LOOP");
+    vmWriter.writePush("constant", 0);
+    vmWriter.writeReturn();
+    vmWriter.writeLabel("LOOP");
+    vmWriter.writePush("local", 0);
+    vmWriter.writePush("constant", names.size());
+    vmWriter.writeArithmetic("lt");
+    vmWriter.writeArithmetic("not");
+    vmWriter.writeIf("END");
+    vmWriter.writePush("static", 0);
+    vmWriter.writePush("local", 0);
+    vmWriter.writePush("local", 0);
+    vmWriter.writeArithmetic("add");
+    vmWriter.writeArithmetic("add");
+    vmWriter.writePop("pointer", 1);
+    vmWriter.writePush("that", 0);
+    vmWriter.writePush("that", 1);
+    vmWriter.writeArithmetic("or");
+    vmWriter.writePush("constant", 0);
+    vmWriter.writeArithmetic("eq");
+    vmWriter.writeIf("NEXT");
+    vmWriter.writeCall("Output.println", 0);
+    vmWriter.writePop("temp", 0);
+    vmWriter.writePush("constant", '#');
+    vmWriter.writeCall("Output.printChar", 1);
+    vmWriter.writePop("temp", 0);
+    vmWriter.writePush("local", 0);
+    vmWriter.writeCall("Output.printInt", 1);
+    vmWriter.writePop("temp", 0);
+    vmWriter.writePush("constant", ' ');
+    vmWriter.writeCall("Output.printChar", 1);
+    vmWriter.writePop("temp", 0);
+    vmWriter.writePush("that", 1); // call and return restore `pointer 1`
+    vmWriter.writeCall("Output.printInt", 1);
+    vmWriter.writePop("temp", 0);
+    vmWriter.writePush("constant", ' ');
+    vmWriter.writeCall("Output.printChar", 1);
+    vmWriter.writePop("temp", 0);
+    vmWriter.writePush("that", 0);
+    vmWriter.writeCall("Output.printInt", 1);
+    vmWriter.writePop("temp", 0);
+    vmWriter.writeLabel("NEXT");
+    vmWriter.writePush("local", 0);
+    vmWriter.writePush("constant", 1);
+    vmWriter.writeArithmetic("add");
+    vmWriter.writePop("local", 0);
+    vmWriter.writeGoTo("LOOP");
+    vmWriter.writeLabel("END");
+    vmWriter.writeCall("Output.println", 0);
+    vmWriter.writePop("temp", 0);
+    vmWriter.writePush("constant", 0);
+    vmWriter.writeReturn();
+    vmWriter.close();
+}
+
+template void Profiler::writeRuntime(VMWriter<FileSink>& vmWriter);
+template void Profiler::writeRuntime(VMWriter<MemorySink>& vmWriter);
+
+void Profiler::writeMap() {
+    std::ofstream map(projectDir / "Profile.map");
+    if (!map) {
+        throw std::runtime_error("Profiler: unable to write " + (projectDir / "Profile.map").string() + ".");
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        map << i << ' ' << names[i] << '\n';
+    }
+}
+
+// Reads the `#id high low` lines printed by Profile.dump; anything else the program printed
+// around them is ignored.
+void Profiler::readCounts(std::filesystem::path profilePath) {
+    std::ifstream input(profilePath);
+    if (!input) {
+        throw std::runtime_error("Profiler: unable to read the profile " + profilePath.string() + ".");
+    }
+    if (names.empty()) {
+        throw std::runtime_error("Profiler: " + (projectDir / "Profile.map").string() + " is missing; build with --instrument first.");
+    }
+    std::stringstream contents;
+    contents << input.rdbuf();
+    std::string text = contents.str();
+    for (size_t hash = text.find('#'); hash != std::string::npos; hash = text.find('#', hash + 1)) {
+        std::istringstream line(text.substr(hash + 1, text.find('\n', hash) - hash));
+        long long number, high, low;
+        if (!(line >> number >> high >> low) || number < 0 || number >= static_cast<long long>(names.size())) continue;
+        counts[names[number]] += high * 65536 + (low & 0xFFFF);
+    }
+}
+
+long long Profiler::count(const std::string& name) const {
+    auto found = counts.find(name);
+    return found == counts.end() ? 0 : found->second;
+}
+
+bool Profiler::hasCounts() const {
+    return !counts.empty();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "VMWriter.hpp"
+
+// Execution counters for --instrument builds and the counts read back for --profile-use.
+//
+// Counters are named `Class.subroutine` for subroutine entries and `Class.subroutine:site`
+// for branches. Their numbers are kept in Profile.map in the project directory, so a file can
+// be reinstrumented on its own without renumbering the counters of the others. The generated
+// Profile class holds the counters and prints them as `#id high low` lines from Profile.dump.
+class Profiler {
+public:
+    Profiler(std::filesystem::path projectDir);
+    int counter(const std::string& name);
+    template <typename Sink> void writeRuntime(VMWriter<Sink>& vmWriter);
+    void readCounts(std::filesystem::path profilePath);
+    long long count(const std::string& name) const;
+    bool hasCounts() const;
+private:
+    void writeMap();
+
+    std::filesystem::path projectDir;
+    std::vector<std::string> names; // by counter number
+    std::unordered_map<std::string, int> numbers;
+    std::unordered_map<std::string, long long> counts;
+    std::mutex mutex;
+};
@@ -38,6 +38,13 @@ void SymbolTable::define(std::string name, std::string type, Kind kind) {
     }
 }
 
+// Constants take no storage: indexOf() returns their value.
+void SymbolTable::defineConstant(std::string name, std::string type, int value) {
+    nameToType[name] = type;
+    nameToKind[name] = CONST;
+    nameToIndex[name] = value;
+}
+
 int SymbolTable::varCount(Kind kind) {
     if (kind == STATIC) return staticIndex;
     if (kind == FIELD) return fieldIndex;
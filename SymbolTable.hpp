@@ -9,6 +9,7 @@ public:
     SymbolTable();
     void reset();
     void define(std::string name, std::string type, Kind kind);
+    void defineConstant(std::string name, std::string type, int value);
     int varCount(Kind kind);
     Kind kindOf(std::string name);
     std::string typeOf(std::string name);
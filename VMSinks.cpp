@@ -0,0 +1,48 @@
+#include "VMSinks.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+FileSink::FileSink(const std::filesystem::path& path) : path(path), buffer(1 << 16), used(0) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open the specified output path for the VMWriter.");
+    }
+}
+
+FileSink::~FileSink() {
+    try {
+        close();
+    }
+    catch (const std::runtime_error&) {} // callers that care about write errors call close()
+}
+
+// Writes out the buffer and closes the file. Later calls do nothing.
+void FileSink::close() {
+    if (fd < 0) return;
+    drain();
+    ::close(fd);
+    fd = -1;
+}
+
+void FileSink::drain() {
+    writeAll(buffer.data(), used);
+    used = 0;
+}
+
+void FileSink::writeAll(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            int error = errno;
+            ::close(fd);
+            fd = -1;
+            throw std::runtime_error("FileSink: unable to write " + path.string() + ": " + std::strerror(error) + ".");
+        }
+        data += written;
+        size -= written;
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Destinations for the text of a VMWriter. The writer is a template over its sink, so each
+// kind of output gets its own inlined emission code. A sink provides
+// append(const char*, size_t), append(char) and close().
+
+// Writes to a file through its own buffer, without iostreams.
+class FileSink {
+public:
+    explicit FileSink(const std::filesystem::path& path);
+    ~FileSink();
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    void append(const char* data, size_t size) {
+        if (size > buffer.size() - used) {
+            drain();
+            if (size > buffer.size()) {
+                writeAll(data, size);
+                return;
+            }
+        }
+        std::copy(data, data + size, buffer.data() + used);
+        used += size;
+    }
+    void append(char c) {
+        if (used == buffer.size()) drain();
+        buffer[used++] = c;
+    }
+    void close();
+private:
+    void drain();
+    void writeAll(const char* data, size_t size);
+
+    std::filesystem::path path;
+    int fd;
+    std::vector<char> buffer;
+    size_t used;
+};
+
+// Collects the text in memory, see contents().
+class MemorySink {
+public:
+    void append(const char* data, size_t size) {
+        text.append(data, size);
+    }
+    void append(char c) {
+        text += c;
+    }
+    void close() {}
+    const std::string& contents() const {
+        return text;
+    }
+private:
+    std::string text;
+};
+
+// Discards the text, counting its bytes; for timing the front end on its own.
+class NullSink {
+public:
+    void append(const char*, size_t size) {
+        bytes += size;
+    }
+    void append(char) {
+        bytes++;
+    }
+    void close() {}
+    size_t size() const {
+        return bytes;
+    }
+private:
+    size_t bytes = 0;
+};
+
+// Computes the 64-bit FNV-1a digest of the text without storing it, so that an output can be
+// compared with a cached one cheaply.
+class HashSink {
+public:
+    void append(const char* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            append(data[i]);
+        }
+    }
+    void append(char c) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        bytes++;
+    }
+    void close() {}
+    uint64_t digest() const {
+        return hash;
+    }
+    size_t size() const {
+        return bytes;
+    }
+private:
+    uint64_t hash = 14695981039346656037ull;
+    size_t bytes = 0;
+};
@@ -1,52 +1,162 @@
-
 #include "VMWriter.hpp"
 #include "Enums.hpp"
-#include <filesystem>
-#include <fstream>
 
-VMWriter::VMWriter(std::filesystem::path outputPath) {
-    outputStream = std::ofstream(outputPath);
-    if (!outputStream) {
-        throw std::runtime_error("Unable to open the specified output path for the VMWriter.");
+bool ThatBinding::operator==(const ThatBinding& other) const {
+    return baseSegment == other.baseSegment && baseIndex == other.baseIndex
+        && indexSegment == other.indexSegment && indexIndex == other.indexIndex;
+}
+
+VMCommandBuffer::VMCommandBuffer() : position({0, 0}), isRecordingPositions(false), hasThatBinding(false), thatGeneration(0) {}
+
+void VMCommandBuffer::writePush(std::string segment, int index) {
+    append(VM_PUSH, segment, index);
+}
+
+void VMCommandBuffer::writePop(std::string segment, int index) {
+    append(VM_POP, segment, index);
+}
+
+void VMCommandBuffer::writeArithmetic(std::string command) {
+    append(VM_ARITHMETIC, command, 0);
+}
+
+void VMCommandBuffer::writeLabel(std::string label) {
+    append(VM_LABEL, label, 0);
+}
+
+void VMCommandBuffer::writeGoTo(std::string label) {
+    append(VM_GOTO, label, 0);
+}
+
+void VMCommandBuffer::writeIf(std::string label) {
+    append(VM_IF, label, 0);
+}
+
+void VMCommandBuffer::writeCall(std::string name, int nArgs) {
+    append(VM_CALL, name, nArgs);
+}
+
+void VMCommandBuffer::writeFunction(std::string name, int nVars) {
+    append(VM_FUNCTION, name, nVars);
+}
+
+void VMCommandBuffer::writeReturn() {
+    append(VM_RETURN, "", 0);
+}
+
+// Adds the positions of the buffered commands to the line map, if recording.
+void VMCommandBuffer::recordFlushedPositions() {
+    if (isRecordingPositions && !commands.empty()) {
+        FunctionPositions function = {commands[0].op == VM_FUNCTION ? commands[0].arg : "", sourceFile, {}};
+        for (const VMCommand& command : commands) {
+            function.positions.push_back(command.position);
+        }
+        lineMap.addFunction(std::move(function));
     }
 }
 
-void VMWriter::writePush(std::string segment, int index) {
-    outputStream << "push " << segment << " " << index << std::endl;
+// Drops the flushed commands; nothing is known about `pointer 1` in the next subroutine.
+void VMCommandBuffer::clear() {
+    commands.clear();
+    hasThatBinding = false;
 }
 
-void VMWriter::writePop(std::string segment, int index) {
-    outputStream << "pop " << segment << " " << index << std::endl;
+size_t VMCommandBuffer::mark() {
+    return commands.size();
 }
 
-void VMWriter::writeArithmetic(std::string command) {
-    outputStream << command << std::endl;
+const std::vector<VMCommand>& VMCommandBuffer::getCommands() {
+    return commands;
 }
 
-void VMWriter::writeLabel(std::string label) {
-    outputStream << "label " << label << std::endl;
+// Removes and returns every command emitted since `from`.
+std::vector<VMCommand> VMCommandBuffer::take(size_t from) {
+    std::vector<VMCommand> taken(commands.begin() + from, commands.end());
+    commands.erase(commands.begin() + from, commands.end());
+    return taken;
 }
 
-void VMWriter::writeGoTo(std::string label) {
-    outputStream << "goto " << label << std::endl;
+void VMCommandBuffer::insert(size_t position, const std::vector<VMCommand>& newCommands) {
+    commands.insert(commands.begin() + position, newCommands.begin(), newCommands.end());
 }
 
-void VMWriter::writeIf(std::string label) {
-    outputStream << "if-goto " << label << std::endl;
+void VMCommandBuffer::erase(size_t from, size_t to) {
+    commands.erase(commands.begin() + from, commands.begin() + to);
 }
 
-void VMWriter::writeCall(std::string name, int nArgs) {
-    outputStream << "call " << name << " " << nArgs << std::endl;
+// The source position of the commands written from now on.
+void VMCommandBuffer::setPosition(SourcePosition newPosition) {
+    position = newPosition;
 }
 
-void VMWriter::writeFunction(std::string name, int nVars) {
-    outputStream << "function " << name << " " << nVars << std::endl;
+// Starts collecting the position of every flushed command, for --line-map.
+void VMCommandBuffer::recordPositions(std::string file) {
+    isRecordingPositions = true;
+    sourceFile = file;
 }
 
-void VMWriter::writeReturn() {
-    outputStream << "return" << std::endl;
+LineMap& VMCommandBuffer::getLineMap() {
+    return lineMap;
 }
 
-void VMWriter::close() {
-    outputStream.close();
-}
\ No newline at end of file
+void VMCommandBuffer::bindThat(const ThatBinding& binding) {
+    hasThatBinding = true;
+    thatBinding = binding;
+    thatGeneration++;
+}
+
+// Changes whenever `that` is bound again, so that a caller can tell the binding it saw from a
+// later one to the same element, whose variables may have changed in between.
+int VMCommandBuffer::getThatGeneration() {
+    return thatGeneration;
+}
+
+bool VMCommandBuffer::isThatBound(const ThatBinding& binding) {
+    return hasThatBinding && thatBinding == binding;
+}
+
+// Forgets the binding, e.g. before compiling code that is not reached from what was just written.
+void VMCommandBuffer::unbindThat() {
+    hasThatBinding = false;
+}
+
+void VMCommandBuffer::append(VMOp op, std::string arg, int index) {
+    commands.push_back({op, arg, index, position});
+    if (hasThatBinding) {
+        invalidateThat(commands.back());
+    }
+}
+
+// Drops the `that` binding when a command may change `pointer 1` or either variable it was computed from.
+void VMCommandBuffer::invalidateThat(const VMCommand& command) {
+    auto usesSegment = [this](const std::string& segment) {
+        return thatBinding.baseSegment == segment || thatBinding.indexSegment == segment;
+    };
+    auto usesVariable = [this](const std::string& segment, int index) {
+        return (thatBinding.baseSegment == segment && thatBinding.baseIndex == index)
+            || (thatBinding.indexSegment == segment && thatBinding.indexIndex == index);
+    };
+    bool inMemory = usesSegment("static") || usesSegment("this"); // may be changed by callees or aliased stores
+    switch (command.op) {
+        case VM_POP:
+            if (command.arg == "pointer") {
+                hasThatBinding = !(command.index == 1 || usesSegment("this"));
+            }
+            else if (command.arg == "that") {
+                hasThatBinding = !inMemory;
+            }
+            else {
+                hasThatBinding = !usesVariable(command.arg, command.index);
+            }
+            break;
+        case VM_CALL:
+            hasThatBinding = !inMemory;
+            break;
+        case VM_LABEL:
+        case VM_FUNCTION:
+            hasThatBinding = false;
+            break;
+        default:
+            break;
+    }
+}
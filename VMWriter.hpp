@@ -1,13 +1,38 @@
 #pragma once
 
+#include <charconv>
 #include <filesystem>
-#include <fstream>
+#include <string>
+#include <vector>
 #include "Enums.hpp"
+#include "LineMap.hpp"
+#include "VMSinks.hpp"
 
-class VMWriter {
-public:
-    VMWriter(std::filesystem::path outputPath);
+// One VM command. Commands are buffered per subroutine so that recently emitted
+// code can be inspected and rewritten before it reaches the output file.
+struct VMCommand {
+    VMOp op;
+    std::string arg; // segment, label, function name or arithmetic command
+    int index;       // segment index, nArgs or nVars
+    SourcePosition position = {0, 0}; // the Jack code it was compiled from
+};
+
+// What `pointer 1` currently holds: the value of a base variable, optionally
+// plus the value of an index variable.
+struct ThatBinding {
+    std::string baseSegment;
+    int baseIndex;
+    std::string indexSegment; // empty when `that` points at the base itself
+    int indexIndex;
+
+    bool operator==(const ThatBinding& other) const;
+};
 
+// The commands of the subroutine being compiled. They are kept until flush() so that recently
+// emitted code can be inspected and rewritten, along with what is known about `pointer 1` and
+// the source position of each command.
+class VMCommandBuffer {
+public:
     void writePush(std::string segment, int index);
     void writePop(std::string segment, int index);
     void writeArithmetic(std::string command);
@@ -17,7 +42,100 @@ public:
     void writeCall(std::string name, int nArgs);
     void writeFunction(std::string name, int nVars);
     void writeReturn();
-    void close();
+
+    size_t mark();
+    const std::vector<VMCommand>& getCommands();
+    std::vector<VMCommand> take(size_t from);
+    void insert(size_t position, const std::vector<VMCommand>& commands);
+    void erase(size_t from, size_t to);
+
+    void setPosition(SourcePosition position);
+    void recordPositions(std::string sourceFile);
+    LineMap& getLineMap();
+
+    void bindThat(const ThatBinding& binding);
+    bool isThatBound(const ThatBinding& binding);
+    int getThatGeneration();
+    void unbindThat();
+protected:
+    VMCommandBuffer();
+    void recordFlushedPositions();
+    void clear();
+
+    std::vector<VMCommand> commands;
+private:
+    void append(VMOp op, std::string arg, int index);
+    void invalidateThat(const VMCommand& command);
+
+    SourcePosition position; // stamped on every appended command
+    bool isRecordingPositions;
+    std::string sourceFile;
+    LineMap lineMap;
+    bool hasThatBinding;
+    ThatBinding thatBinding;
+    int thatGeneration; // counts bindThat() calls
+};
+
+// Formats one command into `sink`, one line per command.
+template <typename Sink>
+void writeCommand(Sink& sink, const VMCommand& command) {
+    auto word = [&sink](const char* text, size_t size) { sink.append(text, size); };
+    auto argument = [&sink, &command]() { sink.append(command.arg.data(), command.arg.size()); };
+    auto index = [&sink, &command]() {
+        char digits[12];
+        char* end = std::to_chars(digits, digits + sizeof(digits), command.index).ptr;
+        sink.append(' ');
+        sink.append(digits, end - digits);
+    };
+    switch (command.op) {
+        case VM_PUSH: word("push ", 5); argument(); index(); break;
+        case VM_POP: word("pop ", 4); argument(); index(); break;
+        case VM_ARITHMETIC: argument(); break;
+        case VM_LABEL: word("label ", 6); argument(); break;
+        case VM_GOTO: word("goto ", 5); argument(); break;
+        case VM_IF: word("if-goto ", 8); argument(); break;
+        case VM_CALL: word("call ", 5); argument(); index(); break;
+        case VM_FUNCTION: word("function ", 9); argument(); index(); break;
+        case VM_RETURN: word("return", 6); break;
+    }
+    sink.append('\n');
+}
+
+// Writes VM code into a sink chosen at compile time: FileSink, MemorySink, NullSink or
+// HashSink (see VMSinks.hpp).
+template <typename Sink>
+class VMWriter : public VMCommandBuffer {
+public:
+    VMWriter() {}
+    explicit VMWriter(std::filesystem::path outputPath) : sink(outputPath) {}
+
+    // Writes out every buffered command. Called once a subroutine has been fully compiled.
+    void flush() {
+        recordFlushedPositions();
+        for (const VMCommand& command : commands) {
+            writeCommand(sink, command);
+        }
+        clear();
+    }
+
+    void close() {
+        flush();
+        sink.close();
+    }
+
+    // Appends text that was already formatted, e.g. by another writer's contents().
+    void writeRaw(const std::string& text) {
+        sink.append(text.data(), text.size());
+    }
+
+    // Everything flushed so far into a MemorySink.
+    std::string contents() {
+        return sink.contents();
+    }
+
+    Sink& getSink() {
+        return sink;
+    }
 private:
-    std::ofstream outputStream;
-};
\ No newline at end of file
+    Sink sink;
+};
@@ -1,13 +1,95 @@
 #include <iostream>
 #include "JackAnalyzer.hpp"
+#include "CompilerOptions.hpp"
+#include "Benchmark.hpp"
+#include "AllocationTracker.hpp"
 #include <stdexcept>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    CompilerOptions options;
+    std::string path;
+    bool benchmark = false;
+    int benchmarkScale = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--no-intrinsics") {
+            options.useIntrinsics = false;
+        }
+        else if (arg == "--cse-report") {
+            options.reportCse = true;
+        }
+        else if (arg == "--constants") {
+            options.constants = true;
+        }
+        else if (arg == "--alloc-report") {
+            AllocationTracker::enable();
+        }
+        else if (arg == "--benchmark") {
+            benchmark = true;
+        }
+        else if (arg.rfind("--benchmark-scale=", 0) == 0) {
+            benchmarkScale = std::atoi(arg.c_str() + 18);
+            if (benchmarkScale < 1) {
+                throw std::runtime_error("Compiler: --benchmark-scale expects a positive number.");
+            }
+        }
+        else if (arg == "--bump-alloc") {
+            options.bumpRegion = 4096;
+        }
+        else if (arg.rfind("--bump-alloc=", 0) == 0) {
+            options.bumpRegion = std::atoi(arg.c_str() + 13);
+            if (options.bumpRegion < 1 || options.bumpRegion > 14000) {
+                throw std::runtime_error("Compiler: --bump-alloc expects a region size between 1 and 14000 words.");
+            }
+        }
+        else if (arg == "--code-report") {
+            options.codeReport = true;
+        }
+        else if (arg == "--line-map") {
+            options.lineMap = true;
+        }
+        else if (arg == "--instrument") {
+            options.instrument = true;
+        }
+        else if (arg.rfind("--profile-use=", 0) == 0) {
+            options.profilePath = arg.substr(14);
+        }
+        else if (arg.rfind("--bundle=", 0) == 0) {
+            options.bundlePath = arg.substr(9);
+        }
+        else if (arg.rfind("--jobs=", 0) == 0) {
+            options.jobs = std::atoi(arg.c_str() + 7);
+            if (options.jobs == 0) options.jobs = std::max(1u, std::thread::hardware_concurrency());
+            if (options.jobs < 0) {
+                throw std::runtime_error("Compiler: --jobs expects a positive number, or 0 for one per hardware thread.");
+            }
+        }
+        else if (arg.rfind("--", 0) == 0) {
+            throw std::runtime_error("Compiler: unknown option " + arg + ".");
+        }
+        else if (path.empty()) {
+            path = arg;
+        }
+        else {
+            throw std::runtime_error("Compiler: you must specify a single directory or file.");
+        }
+    }
+    if (path.empty()) {
         throw std::runtime_error("Compiler: you must specify a single directory or file.");
     }
-    std::string path = argv[1];
-    JackAnalyzer analyzer(path);
+    if (benchmark) {
+        // the path is the work directory for the generated projects
+        Benchmark suite(path, benchmarkScale, options);
+        suite.run(std::cout);
+        return 0;
+    }
+    JackAnalyzer analyzer(path, options);
     analyzer.generateVM();
+    if (AllocationTracker::enabled()) {
+        AllocationTracker::report(std::cout);
+    }
     return 0;
 }
\ No newline at end of file
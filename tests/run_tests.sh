@@ -0,0 +1,80 @@
+#!/bin/bash
+# Compiles every test program with the given compiler and runs it on the VM emulator.
+#
+#   tests/run_tests.sh path/to/compiler [test...]
+#
+# A test is a directory of .jack files with
+#   expected.out  what the program prints;
+#   flags         optional, one set of compiler flags per line, each tried in turn
+#                 (an empty line compiles with the defaults, which is also the default);
+#   limits        optional, lines of "<stat> <maximum> [flags]" checked against the emulator's
+#                 instructions, hack, calls and maxstack counts; a line that names flags
+#                 only applies to that flag set.
+
+compiler=$(realpath "$1")
+if [ ! -x "$compiler" ]; then
+    echo "usage: $0 path/to/compiler [test...]" >&2
+    exit 2
+fi
+shift
+here=$(dirname "$(realpath "$0")")
+tests=("$@")
+if [ ${#tests[@]} -eq 0 ]; then
+    for dir in "$here"/*/; do
+        tests+=("$(basename "$dir")")
+    done
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failed=0
+for test in "${tests[@]}"; do
+    dir="$here/$test"
+    flagSets=("")
+    if [ -f "$dir/flags" ]; then
+        mapfile -t flagSets < "$dir/flags"
+    fi
+    for flags in "${flagSets[@]}"; do
+        name="$test${flags:+ [$flags]}"
+        rm -rf "$work/$test"
+        mkdir -p "$work/$test"
+        cp "$dir"/*.jack "$work/$test"/
+        # shellcheck disable=SC2086
+        if ! "$compiler" $flags "$work/$test" > "$work/compile.log" 2>&1; then
+            echo "FAIL $name: compilation failed"
+            cat "$work/compile.log"
+            failed=1
+            continue
+        fi
+        if ! python3 "$here/vmemu.py" "$work/$test" > "$work/actual.out" 2> "$work/stats"; then
+            echo "FAIL $name: the emulator stopped"
+            cat "$work/stats"
+            failed=1
+            continue
+        fi
+        if ! diff -u "$dir/expected.out" "$work/actual.out" > "$work/diff"; then
+            echo "FAIL $name: unexpected output"
+            cat "$work/diff"
+            failed=1
+            continue
+        fi
+        result=ok
+        if [ -f "$dir/limits" ]; then
+            while read -r stat maximum only; do
+                [ -z "$stat" ] && continue
+                [ -n "$only" ] && [ "$only" != "$flags" ] && continue
+                value=$(tr ' ' '\n' < "$work/stats" | sed -n "s/^$stat=//p")
+                if [ -z "$value" ] || [ "$value" -gt "$maximum" ]; then
+                    echo "FAIL $name: $stat is ${value:-missing}, more than $maximum"
+                    result=failed
+                fi
+            done < "$dir/limits"
+        fi
+        if [ "$result" = ok ]; then
+            echo "ok   $name: $(cat "$work/stats")"
+        else
+            failed=1
+        fi
+    done
+done
+exit $failed
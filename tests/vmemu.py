@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+"""Hack VM emulator for the regression tests.
+
+Runs the .vm files of a directory from Main.main (or Sys.init) and prints what the program
+wrote through Output. The OS classes are implemented natively unless the directory defines
+them. On stderr it reports the executed VM commands, an estimate of the Hack instructions
+they cost, the calls made and the deepest stack, for the `limits` files of the tests.
+"""
+import sys, os
+
+def s16(v):
+    v &= 0xFFFF
+    return v - 0x10000 if v & 0x8000 else v
+
+COST = {'add': 5, 'sub': 5, 'and': 5, 'or': 5, 'neg': 3, 'not': 3, 'eq': 13, 'gt': 13, 'lt': 13, 'label': 0, 'goto': 2, 'if-goto': 5, 'call': 45, 'return': 40, 'function': 2}
+
+class Halt(Exception):
+    pass
+
+class VM:
+    def __init__(self, files):
+        self.code = []          # (op, a, b, fileStem, funcName)
+        self.funcs = {}
+        self.labels = {}
+        cur_func = None
+        for f in files:
+            stem = os.path.splitext(os.path.basename(f))[0]
+            for line in open(f):
+                line = line.split('//')[0].strip()
+                if not line:
+                    continue
+                parts = line.split()
+                op = parts[0]
+                if op == 'function':
+                    cur_func = parts[1]
+                    self.funcs[cur_func] = len(self.code)
+                    self.code.append(('function', parts[1], int(parts[2]), stem, cur_func))
+                elif op == 'label':
+                    if (cur_func, parts[1]) in self.labels:
+                        raise Exception('duplicate label %s in %s' % (parts[1], cur_func))
+                    self.labels[(cur_func, parts[1])] = len(self.code)
+                    self.code.append(('label', parts[1], None, stem, cur_func))
+                elif op in ('push', 'pop'):
+                    self.code.append((op, parts[1], int(parts[2]), stem, cur_func))
+                elif op == 'call':
+                    self.code.append((op, parts[1], int(parts[2]), stem, cur_func))
+                elif op in ('goto', 'if-goto'):
+                    self.code.append((op, parts[1], None, stem, cur_func))
+                else:
+                    self.code.append((op, None, None, stem, cur_func))
+        self.ram = [0] * 32768
+        self.ram[0] = 256
+        self.statics = {}
+        self.heap = 2048
+        self.free = {}
+        self.out = []
+        self.count = 0
+        self.calls = 0
+        self.native_calls = {}
+        self.maxsp = 256
+        self.hack = 0
+
+    def push(self, v):
+        self.ram[self.ram[0]] = s16(v)
+        self.ram[0] += 1
+        if self.ram[0] > self.maxsp:
+            self.maxsp = self.ram[0]
+
+    def pop(self):
+        self.ram[0] -= 1
+        return self.ram[self.ram[0]]
+
+    def addr(self, seg, i, stem):
+        if seg == 'local': return self.ram[1] + i
+        if seg == 'argument': return self.ram[2] + i
+        if seg == 'this': return self.ram[3] + i
+        if seg == 'that': return self.ram[4] + i
+        if seg == 'pointer': return 3 + i
+        if seg == 'temp': return 5 + i
+        if seg == 'static':
+            key = (stem, i)
+            if key not in self.statics:
+                self.statics[key] = 16 + len(self.statics)
+            return self.statics[key]
+        raise Exception('bad segment ' + seg)
+
+    def alloc(self, n):
+        n = max(n, 1)
+        lst = self.free.get(n)
+        if lst:
+            return lst.pop()
+        a = self.heap
+        self.heap += n + 1
+        self.ram[a] = n
+        if self.heap > 16384:
+            raise Exception('heap overflow')
+        return a + 1
+
+    def native(self, name, args):
+        self.native_calls[name] = self.native_calls.get(name, 0) + 1
+        r = self.ram
+        if name == 'Math.multiply': return args[0] * args[1]
+        if name == 'Math.divide':
+            a, b = args
+            q = abs(a) // abs(b)
+            return -q if (a < 0) != (b < 0) else q
+        if name == 'Math.abs': return abs(args[0])
+        if name == 'Math.min': return min(args)
+        if name == 'Math.max': return max(args)
+        if name == 'Math.sqrt':
+            x = 0
+            while (x + 1) * (x + 1) <= args[0]: x += 1
+            return x
+        if name in ('Memory.alloc', 'Array.new'): return self.alloc(args[0])
+        if name in ('Memory.deAlloc', 'Array.dispose'):
+            a = args[0]
+            if a > 0:
+                self.free.setdefault(r[a - 1], []).append(a)
+            return 0
+        if name == 'Memory.peek': return r[args[0]]
+        if name == 'Memory.poke':
+            r[args[0]] = s16(args[1]); return 0
+        if name == 'String.new':
+            a = self.alloc(args[0] + 2); r[a] = args[0]; r[a + 1] = 0; return a
+        if name == 'String.appendChar':
+            a = args[0]; r[a + 2 + r[a + 1]] = args[1]; r[a + 1] += 1; return a
+        if name == 'String.length': return r[args[0] + 1]
+        if name == 'String.charAt': return r[args[0] + 2 + args[1]]
+        if name == 'String.dispose': return 0
+        if name == 'Output.printInt': self.out.append(str(args[0])); return 0
+        if name == 'Output.printChar': self.out.append(chr(args[0])); return 0
+        if name == 'Output.printString':
+            a = args[0]; self.out.append(''.join(chr(r[a + 2 + k]) for k in range(r[a + 1]))); return 0
+        if name == 'Output.println': self.out.append('\n'); return 0
+        if name == 'Sys.halt': raise Halt()
+        if name == 'Sys.error': self.out.append('ERR%d' % args[0]); raise Halt()
+        if name == 'Memory.init' or name == 'Output.init' or name == 'Math.init': return 0
+        raise Exception('unknown function ' + name)
+
+    def run(self, limit=50_000_000):
+        entry = 'Sys.init' if 'Sys.init' in self.funcs else 'Main.main'
+        r = self.ram
+        code = self.code
+        # bootstrap: call entry with 0 args and sentinel return address -1
+        self.push(-1); self.push(r[1]); self.push(r[2]); self.push(r[3]); self.push(r[4])
+        r[2] = r[0] - 5; r[1] = r[0]
+        pc = self.funcs[entry]
+        try:
+            while True:
+                if pc < 0:
+                    break
+                op, a, b, stem, fn = code[pc]
+                self.count += 1
+                if self.count > limit:
+                    raise Exception('instruction limit')
+                pc += 1
+                self.hack += COST.get(op, 6) if op not in ('push', 'pop') else (7 if a == 'constant' else (6 if a in ('pointer', 'temp', 'static') else 11 if op == 'push' else 13))
+                if op == 'function': self.hack += 4 * b
+                if op == 'push':
+                    if a == 'constant': self.push(b)
+                    else: self.push(r[self.addr(a, b, stem)])
+                elif op == 'pop':
+                    v = self.pop(); r[self.addr(a, b, stem)] = v
+                elif op == 'add': y = self.pop(); x = self.pop(); self.push(x + y)
+                elif op == 'sub': y = self.pop(); x = self.pop(); self.push(x - y)
+                elif op == 'neg': self.push(-self.pop())
+                elif op == 'not': self.push(~self.pop())
+                elif op == 'and': y = self.pop(); x = self.pop(); self.push(x & y)
+                elif op == 'or': y = self.pop(); x = self.pop(); self.push(x | y)
+                elif op == 'eq': y = self.pop(); x = self.pop(); self.push(-1 if x == y else 0)
+                elif op == 'gt': y = self.pop(); x = self.pop(); self.push(-1 if x > y else 0)
+                elif op == 'lt': y = self.pop(); x = self.pop(); self.push(-1 if x < y else 0)
+                elif op == 'label': self.count -= 1
+                elif op == 'goto': pc = self.labels[(fn, a)]
+                elif op == 'if-goto':
+                    if self.pop() != 0: pc = self.labels[(fn, a)]
+                elif op == 'function':
+                    for _ in range(b): self.push(0)
+                elif op == 'call':
+                    self.calls += 1
+                    if a in self.funcs:
+                        r[r[0]] = pc; r[0] += 1; self.push(r[1]); self.push(r[2]); self.push(r[3]); self.push(r[4])
+                        r[2] = r[0] - 5 - b; r[1] = r[0]
+                        pc = self.funcs[a]
+                    else:
+                        args = [r[r[0] - b + k] for k in range(b)]
+                        r[0] -= b
+                        self.push(self.native(a, args))
+                elif op == 'return':
+                    frame = r[1]
+                    ret = r[frame - 5]
+                    r[r[2]] = self.pop()
+                    r[0] = r[2] + 1
+                    r[4] = r[frame - 1]; r[3] = r[frame - 2]; r[2] = r[frame - 3]; r[1] = r[frame - 4]
+                    pc = ret
+                else:
+                    raise Exception('bad op ' + op)
+        except Halt:
+            pass
+
+if __name__ == '__main__':
+    d = sys.argv[1]
+    files = sorted(os.path.join(d, f) for f in os.listdir(d) if f.endswith('.vm')) if os.path.isdir(d) else sys.argv[1:]
+    vm = VM(files)
+    vm.run()
+    sys.stdout.write(''.join(vm.out) + '\n')
+    sys.stderr.write('instructions=%d hack=%d calls=%d maxstack=%d\n' % (vm.count, vm.hack, vm.calls, vm.maxsp - 256))